@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <fstream>
 #include "Image.hpp"
+#include "ppm.hpp"
+#include "profile.hpp"
 
 //written by Ian Kim 
 
@@ -9,67 +14,127 @@
 // EFFECTS:  Initializes the Image with the given width and height, with
 //           all pixels initialized to RGB values of 0.
 void Image_init(Image* img, int width, int height) {
+  Image_init(img, width, height, IMAGE_CHANNELS);
+}
+
+// REQUIRES: img points to an Image
+//           0 < width && 0 < height
+//           channels == 1 || channels == IMAGE_CHANNELS
+// MODIFIES: *img
+// EFFECTS:  Initializes the Image with the given width and height and
+//           number of channels (1 for grayscale), with all values 0.
+void Image_init(Image* img, int width, int height, int channels) {
   img->width = width;
   img->height = height;
+  img->channels = channels;
+  img->stride = width;
+  img->plane_rows = height;
 
-  Matrix red;
-  Matrix_init(&red, width, height);
-  img->red_channel = red;
+  img->data.assign(channels * width * height, 0);
+}
 
-  Matrix green;
-  Matrix_init(&green, width, height);
-  img->green_channel = green;
+// Reads an image from an initialized reader straight into the channel
+// planes of *img.
+static bool read_image(Image* img, PPM_Reader* reader, PPM_Format* format,
+                       std::string* error) {
+  PROFILE_SCOPE(PROFILE_READ, 0);
+  PPM_Header header;
+  if (!PPM_read_header(reader, &header, error)) {
+    return false;
+  }
+  if (format) {
+    *format = header.format;
+  }
+  // pixel data is indexed with int, three bytes per pixel
+  if (static_cast<long long>(header.width) * header.height > INT_MAX / 3) {
+    *error = "image is too large";
+    return false;
+  }
 
-  Matrix blue;
-  Matrix_init(&blue, width, height);
-  img->blue_channel = blue;
+  // grayscale files keep their single channel
+  if (header.format == PPM_P5) {
+    Image_init(img, header.width, header.height, 1);
+    for (int i = 0; i < header.height; i++) {
+      if (!PPM_read_gray_row(reader, &header, Image_row(img, 0, i), error)) {
+        return false;
+      }
+    }
+  } else {
+    Image_init(img, header.width, header.height);
+    for (int i = 0; i < header.height; i++) {
+      if (!PPM_read_row(reader, &header, Image_row(img, 0, i),
+                        Image_row(img, 1, i), Image_row(img, 2, i), error)) {
+        return false;
+      }
+    }
+  }
+
+  PROFILE_BYTES(static_cast<long long>(Image_channels(img)) * header.width *
+                header.height);
+  return true;
 }
 
 // REQUIRES: img points to an Image
-//           is contains an image in PPM format without comments
-//           (any kind of whitespace is ok)
+//           is contains an image in PPM format
+//           (any kind of whitespace is ok, and comments are skipped)
 // MODIFIES: *img, is
 // EFFECTS:  Initializes the Image by reading in an image in PPM format
-//           from the given input stream.
+//           from the given input stream. If the image is malformed, the
+//           failbit of is is set and *img is left unspecified.
 void Image_init(Image* img, std::istream& is) {
-  std::string header;
-  is >> header;
-
-  std::string shouldBe = "P3";
-  assert(header == shouldBe);
-  
-  int width;
-  int height;
-  int rgbIntensity;
-
-  is >> width;
-  img->width = width;
-
-  is >> height;
-  img -> height = height;
-
-
-  is >> rgbIntensity;
-
-  Matrix_init(&img->red_channel, width, height);
-  Matrix_init(&img->green_channel, width, height);
-  Matrix_init(&img->blue_channel, width, height);
-
-  for (int i = 0; i < height; i++) {
-    for (int j = 0; j < width; j++) {
-      int red;
-      int green;
-      int blue;
+  std::string error;
+  if (!Image_read(img, is, &error)) {
+    is.setstate(std::ios::failbit);
+  }
+}
 
-      is >> red;
-      is >> green;
-      is >> blue;
+// REQUIRES: img points to an Image
+// MODIFIES: *img, is, *error
+// EFFECTS:  Initializes the Image by reading in an image in P3, P5 or P6
+//           format from the given input stream. Returns false and sets
+//           *error to a description of the problem if the image is
+//           malformed.
+bool Image_read(Image* img, std::istream& is, std::string* error) {
+  PPM_Reader reader;
+  PPM_Reader_init(&reader, is);
+  return read_image(img, &reader, nullptr, error);
+}
 
-      *Matrix_at(&img->red_channel, i, j) = red;
-      *Matrix_at(&img->green_channel, i, j) = green;
-      *Matrix_at(&img->blue_channel, i, j) = blue;
-    }
+// REQUIRES: img points to an Image
+//           format is null or points to a PPM_Format
+// MODIFIES: *img, *format, *error
+// EFFECTS:  Initializes the Image by reading in the named P3, P5 or P6
+//           file, which is memory-mapped where possible; the format is
+//           detected from the magic number and stored in *format if
+//           format is not null. A P5 image is stored in one gray
+//           channel. Returns false and sets *error if the file cannot be
+//           opened or is malformed.
+bool Image_read_file(Image* img, const std::string& filename,
+                     PPM_Format* format, std::string* error) {
+  PPM_Reader reader;
+  if (!PPM_Reader_open(&reader, filename.c_str(), error)) {
+    return false;
   }
+  bool ok = read_image(img, &reader, format, error);
+  PPM_Reader_close(&reader);
+  return ok;
+}
+
+// REQUIRES: img points to an Image
+//           data points to at least size bytes
+//           format is null or points to a PPM_Format
+// MODIFIES: *img, *format, *error
+// EFFECTS:  Initializes the Image by reading in a P3, P5 or P6 file held
+//           in [data, data + size), without copying it; the format is
+//           detected from the magic number and stored in *format if
+//           format is not null. A P5 image is stored in one gray
+//           channel. Returns false and sets *error if the image is
+//           malformed.
+bool Image_read_memory(Image* img, const char* data, std::size_t size,
+                       PPM_Format* format, std::string* error) {
+  PPM_Reader reader;
+  PPM_Reader_init(&reader, data, size);
+  return read_image(img, &reader, format, error);
 }
 
 // REQUIRES: img points to a valid Image
@@ -87,18 +152,52 @@ void Image_init(Image* img, std::istream& is) {
 //           "extra" space at the end of each line. See the project spec
 //           for an example.
 void Image_print(const Image* img, std::ostream& os) {
-  os << "P3\n"
-  << img->width << " " << img->height << "\n"
-  << "255" << std::endl;
+  Image_write(img, os, PPM_P3);
+}
+
+// REQUIRES: img points to a valid Image
+// MODIFIES: os
+// EFFECTS:  Writes the image to the given output stream in the given
+//           format. P3 output is exactly what Image_print writes; see
+//           PPM_write_row for how P5 and P6 store pixels. A grayscale
+//           image is written as if its three channels were equal.
+void Image_write(const Image* img, std::ostream& os, PPM_Format format) {
+  PROFILE_SCOPE(PROFILE_WRITE, static_cast<long long>(img->channels) *
+                               img->width * img->height);
+  PPM_Writer writer;
+  PPM_Writer_init(&writer, os);
+  PPM_write_header(&writer, format, img->width, img->height);
 
   for (int i = 0; i < img->height; i++) {
-    for (int j = 0; j < img->width; j++) {
-      os << *Matrix_at(&img->red_channel, i, j) << " ";
-      os << *Matrix_at(&img->green_channel, i, j) << " ";
-      os << *Matrix_at(&img->blue_channel, i, j) << " ";
+    if (img->channels == 1) {
+      PPM_write_gray_row(&writer, Image_row(img, 0, i), img->width);
+    } else {
+      PPM_write_row(&writer, Image_row(img, 0, i), Image_row(img, 1, i),
+                    Image_row(img, 2, i), img->width);
     }
-    os << std::endl;
   }
+
+  PPM_Writer_finish(&writer);
+}
+
+// REQUIRES: img points to a valid Image
+// MODIFIES: the named file, *error
+// EFFECTS:  Writes the image to the named file in the given format.
+//           Returns false and sets *error if the file cannot be written.
+bool Image_write_file(const Image* img, const std::string& filename,
+                      PPM_Format format, std::string* error) {
+  std::ofstream fout(filename, std::ios::binary);
+  if (!fout) {
+    *error = "cannot open " + filename + " for writing";
+    return false;
+  }
+
+  Image_write(img, fout, format);
+  if (!fout) {
+    *error = "error while writing " + filename;
+    return false;
+  }
+  return true;
 }
 
 // REQUIRES: img points to a valid Image
@@ -113,16 +212,56 @@ int Image_height(const Image* img) {
   return img->height;
 }
 
+// REQUIRES: img points to a valid Image
+// EFFECTS:  Returns the number of channels the Image stores: 1 for a
+//           grayscale image and IMAGE_CHANNELS for a color one.
+int Image_channels(const Image* img) {
+  return img->channels;
+}
+
+// REQUIRES: img points to a valid Image
+// EFFECTS:  Returns the number of pixel values the Image holds, one byte
+//           each: width times height times channels.
+long long Image_bytes(const Image* img) {
+  return static_cast<long long>(img->channels) * img->width * img->height;
+}
+
+// REQUIRES: img points to a valid Image
+//           0 <= channel && channel < Image_channels(img)
+//           0 <= row && row < Image_height(img)
+// MODIFIES: (The returned pointer may be used to modify the row.)
+// EFFECTS:  Returns a pointer to the first of the Image_width(img) values
+//           of the given channel (0 = red, 1 = green, 2 = blue, or 0 =
+//           gray) in the given row.
+unsigned char* Image_row(Image* img, int channel, int row) {
+  return &img->data[(channel * img->plane_rows + row) * img->stride];
+}
+
+// REQUIRES: img points to a valid Image
+//           0 <= channel && channel < Image_channels(img)
+//           0 <= row && row < Image_height(img)
+// EFFECTS:  Returns a pointer-to-const to the first of the Image_width(img)
+//           values of the given channel in the given row.
+const unsigned char* Image_row(const Image* img, int channel, int row) {
+  return &img->data[(channel * img->plane_rows + row) * img->stride];
+}
+
 // REQUIRES: img points to a valid Image
 //           0 <= row && row < Image_height(img)
 //           0 <= column && column < Image_width(img)
 // EFFECTS:  Returns the pixel in the Image at the given row and column.
+//           A gray pixel has equal red, green and blue values.
 Pixel Image_get_pixel(const Image* img, int row, int column) {
   Pixel toReturn;
 
-  toReturn.r = *Matrix_at(&img->red_channel, row, column);
-  toReturn.g = *Matrix_at(&img->green_channel, row, column);
-  toReturn.b = *Matrix_at(&img->blue_channel, row, column);
+  if (img->channels == 1) {
+    toReturn.r = toReturn.g = toReturn.b = Image_row(img, 0, row)[column];
+    return toReturn;
+  }
+
+  toReturn.r = Image_row(img, 0, row)[column];
+  toReturn.g = Image_row(img, 1, row)[column];
+  toReturn.b = Image_row(img, 2, row)[column];
 
   return toReturn;
   //i see why its so important to write your starting functions well now
@@ -131,24 +270,64 @@ Pixel Image_get_pixel(const Image* img, int row, int column) {
 // REQUIRES: img points to a valid Image
 //           0 <= row && row < Image_height(img)
 //           0 <= column && column < Image_width(img)
+//           each component of color is between 0 and MAX_INTENSITY
 // MODIFIES: *img
 // EFFECTS:  Sets the pixel in the Image at the given row and column
-//           to the given color.
+//           to the given color. A grayscale image stores the color's luma
+//           (see PPM_luma_row).
 void Image_set_pixel(Image* img, int row, int column, Pixel color) {
-  *Matrix_at(&img->red_channel, row, column) = color.r;
-  *Matrix_at(&img->green_channel, row, column) = color.g;
-  *Matrix_at(&img->blue_channel, row, column) = color.b;
+  if (img->channels == 1) {
+    const unsigned char r = static_cast<unsigned char>(color.r);
+    const unsigned char g = static_cast<unsigned char>(color.g);
+    const unsigned char b = static_cast<unsigned char>(color.b);
+    PPM_luma_row(&r, &g, &b, Image_row(img, 0, row) + column, 1);
+    return;
+  }
+  Image_row(img, 0, row)[column] = static_cast<unsigned char>(color.r);
+  Image_row(img, 1, row)[column] = static_cast<unsigned char>(color.g);
+  Image_row(img, 2, row)[column] = static_cast<unsigned char>(color.b);
 }
 
 // REQUIRES: img points to a valid Image
 // MODIFIES: *img
-// EFFECTS:  Sets each pixel in the image to the given color.
+// EFFECTS:  Sets each pixel in the image to the given color, as
+//           Image_set_pixel does.
 void Image_fill(Image* img, Pixel color) {
-  for (int i = 0; i < img->height; i++) {
-    for (int j = 0; j < img->width; j++) {
-      *Matrix_at(&img->red_channel, i, j) = color.r;
-      *Matrix_at(&img->green_channel, i, j) = color.g;
-      *Matrix_at(&img->blue_channel, i, j) = color.b;
+  unsigned char values[IMAGE_CHANNELS] = {
+    static_cast<unsigned char>(color.r), static_cast<unsigned char>(color.g),
+    static_cast<unsigned char>(color.b)
+  };
+  if (img->channels == 1) {
+    unsigned char luma;
+    PPM_luma_row(&values[0], &values[1], &values[2], &luma, 1);
+    values[0] = luma;
+  }
+
+  for (int c = 0; c < img->channels; c++) {
+    for (int i = 0; i < img->height; i++) {
+      unsigned char* row = Image_row(img, c, i);
+      for (int j = 0; j < img->width; j++) {
+        row[j] = values[c];
+      }
+    }
+  }
+}
+
+// REQUIRES: src points to a valid Image, dst points to an Image
+//           dst is not src
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to a grayscale image of the luma of src
+//           (see PPM_luma_row); a grayscale src is copied. Memory *dst
+//           already holds is reused.
+void Image_luma(const Image* src, Image* dst) {
+  Image_init(dst, src->width, src->height, 1);
+  for (int i = 0; i < src->height; i++) {
+    if (src->channels == 1) {
+      std::copy(Image_row(src, 0, i), Image_row(src, 0, i) + src->width,
+                Image_row(dst, 0, i));
+    } else {
+      PPM_luma_row(Image_row(src, 0, i), Image_row(src, 1, i),
+                   Image_row(src, 2, i), Image_row(dst, 0, i), src->width);
     }
   }
 }
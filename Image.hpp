@@ -7,7 +7,11 @@
  */
 
 #include <iostream>
+#include <string>
+#include <vector>
 #include "Matrix.hpp"
+#include "memory.hpp"
+#include "ppm.hpp"
 
 // Representation of an RGB Pixel used for
 // parameter passing and returns by the
@@ -20,14 +24,25 @@ struct Pixel {
 
 const int MAX_INTENSITY = 255;
 
-// Representation of 2D RGB image.
+// Number of channels (red, green, blue) stored for each pixel of a color
+// image. A grayscale image stores one.
+const int IMAGE_CHANNELS = 3;
+
+// Representation of 2D RGB or grayscale image.
 // Image objects may be copied.
+// Each channel is stored as a plane of 8-bit values, red first, then
+// green, then blue; a grayscale image has a single plane of gray values,
+// and reads as if all three channels held them. Within a plane, rows are
+// stride bytes apart; like Matrix, the stride stays fixed when columns
+// are removed so rows can be compacted in place. Likewise each plane
+// keeps room for plane_rows rows when rows are removed.
 struct Image {
   int width;
   int height;
-  Matrix red_channel;
-  Matrix green_channel;
-  Matrix blue_channel;
+  int channels;
+  int stride;
+  int plane_rows;
+  Tracked_Vector<unsigned char> data;
 };
 
 // REQUIRES: img points to an Image
@@ -38,13 +53,55 @@ struct Image {
 void Image_init(Image* img, int width, int height);
 
 // REQUIRES: img points to an Image
-//           is contains an image in PPM format without comments
-//           (any kind of whitespace is ok)
+//           0 < width && 0 < height
+//           channels == 1 || channels == IMAGE_CHANNELS
+// MODIFIES: *img
+// EFFECTS:  Initializes the Image with the given width and height and
+//           number of channels (1 for grayscale), with all values 0.
+void Image_init(Image* img, int width, int height, int channels);
+
+// REQUIRES: img points to an Image
+//           is contains an image in PPM format
+//           (any kind of whitespace is ok, and comments are skipped)
 // MODIFIES: *img, is
 // EFFECTS:  Initializes the Image by reading in an image in PPM format
-//           from the given input stream.
+//           from the given input stream. If the image is malformed, the
+//           failbit of is is set and *img is left unspecified.
 void Image_init(Image* img, std::istream& is);
 
+// REQUIRES: img points to an Image
+// MODIFIES: *img, is, *error
+// EFFECTS:  Initializes the Image by reading in an image in P3, P5 or P6
+//           format from the given input stream. Returns false and sets
+//           *error to a description of the problem if the image is
+//           malformed.
+bool Image_read(Image* img, std::istream& is, std::string* error);
+
+// REQUIRES: img points to an Image
+//           format is null or points to a PPM_Format
+// MODIFIES: *img, *format, *error
+// EFFECTS:  Initializes the Image by reading in the named P3, P5 or P6
+//           file, which is memory-mapped where possible; the format is
+//           detected from the magic number and stored in *format if
+//           format is not null. A P5 image is stored in one gray
+//           channel. Returns false and sets *error if the file cannot be
+//           opened or is malformed.
+bool Image_read_file(Image* img, const std::string& filename,
+                     PPM_Format* format, std::string* error);
+
+// REQUIRES: img points to an Image
+//           data points to at least size bytes
+//           format is null or points to a PPM_Format
+// MODIFIES: *img, *format, *error
+// EFFECTS:  Initializes the Image by reading in a P3, P5 or P6 file held
+//           in [data, data + size), without copying it; the format is
+//           detected from the magic number and stored in *format if
+//           format is not null. A P5 image is stored in one gray
+//           channel. Returns false and sets *error if the image is
+//           malformed.
+bool Image_read_memory(Image* img, const char* data, std::size_t size,
+                       PPM_Format* format, std::string* error);
+
 // REQUIRES: img points to a valid Image
 // MODIFIES: os
 // EFFECTS:  Writes the image to the given output stream in PPM format.
@@ -61,6 +118,21 @@ void Image_init(Image* img, std::istream& is);
 //           for an example.
 void Image_print(const Image* img, std::ostream& os);
 
+// REQUIRES: img points to a valid Image
+// MODIFIES: os
+// EFFECTS:  Writes the image to the given output stream in the given
+//           format. P3 output is exactly what Image_print writes; see
+//           PPM_write_row for how P5 and P6 store pixels. A grayscale
+//           image is written as if its three channels were equal.
+void Image_write(const Image* img, std::ostream& os, PPM_Format format);
+
+// REQUIRES: img points to a valid Image
+// MODIFIES: the named file, *error
+// EFFECTS:  Writes the image to the named file in the given format.
+//           Returns false and sets *error if the file cannot be written.
+bool Image_write_file(const Image* img, const std::string& filename,
+                      PPM_Format format, std::string* error);
+
 // REQUIRES: img points to a valid Image
 // EFFECTS:  Returns the width of the Image.
 int Image_width(const Image* img);
@@ -69,23 +141,61 @@ int Image_width(const Image* img);
 // EFFECTS:  Returns the height of the Image.
 int Image_height(const Image* img);
 
+// REQUIRES: img points to a valid Image
+// EFFECTS:  Returns the number of channels the Image stores: 1 for a
+//           grayscale image and IMAGE_CHANNELS for a color one.
+int Image_channels(const Image* img);
+
+// REQUIRES: img points to a valid Image
+// EFFECTS:  Returns the number of pixel values the Image holds, one byte
+//           each: width times height times channels.
+long long Image_bytes(const Image* img);
+
+// REQUIRES: img points to a valid Image
+//           0 <= channel && channel < Image_channels(img)
+//           0 <= row && row < Image_height(img)
+// MODIFIES: (The returned pointer may be used to modify the row.)
+// EFFECTS:  Returns a pointer to the first of the Image_width(img) values
+//           of the given channel (0 = red, 1 = green, 2 = blue, or 0 =
+//           gray) in the given row.
+unsigned char* Image_row(Image* img, int channel, int row);
+
+// REQUIRES: img points to a valid Image
+//           0 <= channel && channel < Image_channels(img)
+//           0 <= row && row < Image_height(img)
+// EFFECTS:  Returns a pointer-to-const to the first of the Image_width(img)
+//           values of the given channel in the given row.
+const unsigned char* Image_row(const Image* img, int channel, int row);
+
 // REQUIRES: img points to a valid Image
 //           0 <= row && row < Image_height(img)
 //           0 <= column && column < Image_width(img)
 // EFFECTS:  Returns the pixel in the Image at the given row and column.
+//           A gray pixel has equal red, green and blue values.
 Pixel Image_get_pixel(const Image* img, int row, int column);
 
 // REQUIRES: img points to a valid Image
 //           0 <= row && row < Image_height(img)
 //           0 <= column && column < Image_width(img)
+//           each component of color is between 0 and MAX_INTENSITY
 // MODIFIES: *img
 // EFFECTS:  Sets the pixel in the Image at the given row and column
-//           to the given color.
+//           to the given color. A grayscale image stores the color's luma
+//           (see PPM_luma_row).
 void Image_set_pixel(Image* img, int row, int column, Pixel color);
 
 // REQUIRES: img points to a valid Image
 // MODIFIES: *img
-// EFFECTS:  Sets each pixel in the image to the given color.
+// EFFECTS:  Sets each pixel in the image to the given color, as
+//           Image_set_pixel does.
 void Image_fill(Image* img, Pixel color);
 
+// REQUIRES: src points to a valid Image, dst points to an Image
+//           dst is not src
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to a grayscale image of the luma of src
+//           (see PPM_luma_row); a grayscale src is copied. Memory *dst
+//           already holds is reused.
+void Image_luma(const Image* src, Image* dst);
+
 #endif // IMAGE_HPP
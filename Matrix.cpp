@@ -1,22 +1,38 @@
 #include <cassert>
+#include <cstring>
 #include "Matrix.hpp"
 
 // REQUIRES: mat points to a Matrix
 //           0 < width && 0 < height
 // MODIFIES: *mat
 // EFFECTS:  Initializes *mat as a Matrix with the given width and height,
-//           with all elements initialized to 0.
+//           with all elements initialized to 0. The stride is set to width.
 void Matrix_init(Matrix* mat, int width, int height) {
   mat->data.resize(width * height);
 
   mat->width = width;
   mat->height = height;
+  mat->stride = width;
 
   for (int i = 0; i < width * height; i++) {
     mat->data[i] = 0;
   }
 }
 
+// REQUIRES: mat points to a Matrix
+//           0 < width && 0 < height
+// MODIFIES: *mat
+// EFFECTS:  Like Matrix_init, but the elements are left unspecified, for
+//           callers that overwrite all of them. Nothing is allocated if
+//           *mat already had room for width * height elements.
+void Matrix_reshape(Matrix* mat, int width, int height) {
+  mat->data.resize(width * height);
+
+  mat->width = width;
+  mat->height = height;
+  mat->stride = width;
+}
+
 // REQUIRES: mat points to a valid Matrix
 // MODIFIES: os
 // EFFECTS:  First, prints the width and height for the Matrix to os:
@@ -30,7 +46,7 @@ void Matrix_print(const Matrix* mat, std::ostream& os) {
 
   for (int i = 0; i < mat->height; i++) {
     for (int j = 0; j < mat->width; j++) {
-      os << mat->data[i * mat->width + j] << " ";
+      os << mat->data[i * mat->stride + j] << " ";
     }
     os << std::endl;
   }
@@ -57,7 +73,7 @@ int Matrix_height(const Matrix* mat) {
 // EFFECTS:  Returns a pointer to the element in the Matrix
 //           at the given row and column.
 int* Matrix_at(Matrix* mat, int row, int column) {
-  int* ptr = &mat->data[(row * mat->width) + column];
+  int* ptr = &mat->data[(row * mat->stride) + column];
   return ptr;
 }
 
@@ -68,7 +84,7 @@ int* Matrix_at(Matrix* mat, int row, int column) {
 // EFFECTS:  Returns a pointer-to-const to the element in
 //           the Matrix at the given row and column.
 const int* Matrix_at(const Matrix* mat, int row, int column) {
-  const int* ptr = &mat->data[(row * mat->width) + column];
+  const int* ptr = &mat->data[(row * mat->stride) + column];
   return ptr;
 }
 
@@ -76,8 +92,11 @@ const int* Matrix_at(const Matrix* mat, int row, int column) {
 // MODIFIES: *mat
 // EFFECTS:  Sets each element of the Matrix to the given value.
 void Matrix_fill(Matrix* mat, int value) {
-  for (int i = 0; i < mat->data.size(); i++) {
-    mat->data[i] = value;
+  for (int i = 0; i < mat->height; i++) {
+    int* row = &mat->data[i * mat->stride];
+    for (int j = 0; j < mat->width; j++) {
+      row[j] = value;
+    }
   }
 }
 
@@ -87,12 +106,15 @@ void Matrix_fill(Matrix* mat, int value) {
 //           the given value. These are all elements in the first/last
 //           row or the first/last column.
 void Matrix_fill_border(Matrix* mat, int value) {
-  for (int i = 0; i < mat->data.size(); i++) { //no matter what, first and last row are considered border
-    if (i < mat->width || i >= mat->data.size() - mat->width) {
-      mat->data[i] = value;
-    } else if (i % mat->width == 0 || i % mat->width == mat->width - 1) { //any number at the beginning or end of a row
-      mat->data[i] = value;
-    }
+  // only the border is touched, so this is O(width + height) rather than
+  // a pass over the whole matrix
+  for (int j = 0; j < mat->width; j++) {
+    mat->data[j] = value;
+    mat->data[(mat->height - 1) * mat->stride + j] = value;
+  }
+  for (int i = 1; i < mat->height - 1; i++) {
+    mat->data[i * mat->stride] = value;
+    mat->data[i * mat->stride + mat->width - 1] = value;
   }
 }
 
@@ -101,9 +123,12 @@ void Matrix_fill_border(Matrix* mat, int value) {
 int Matrix_max(const Matrix* mat) {
   int cur = mat->data[0];
 
-  for (int i = 1; i < mat->data.size(); i++) {
-    if (mat->data[i] > cur) {
-      cur = mat->data[i];
+  for (int i = 0; i < mat->height; i++) {
+    const int* row = &mat->data[i * mat->stride];
+    for (int j = 0; j < mat->width; j++) {
+      if (row[j] > cur) {
+        cur = row[j];
+      }
     }
   }
 
@@ -126,10 +151,10 @@ int Matrix_column_of_min_value_in_row(const Matrix* mat, int row,
   int column_start, int column_end) {
   
     int min_col = column_start;
-    int poundcake = mat->data[(row * mat->width) + column_start];
+    int poundcake = mat->data[(row * mat->stride) + column_start];
 
     for (int i = column_start + 1; i < column_end; i++) {
-        int jaegyoboss = mat->data[(row * mat->width) + i];
+        int jaegyoboss = mat->data[(row * mat->stride) + i];
 
         if (jaegyoboss < poundcake) {
           poundcake = jaegyoboss;
@@ -150,10 +175,10 @@ int Matrix_column_of_min_value_in_row(const Matrix* mat, int row,
 int Matrix_min_value_in_row(const Matrix* mat, int row,
                             int column_start, int column_end) {
 
-  int poundcake = mat->data[(row * mat->width) + column_start];
+  int poundcake = mat->data[(row * mat->stride) + column_start];
 
   for (int i = column_start + 1; i < column_end; i++) {
-        int cur = mat->data[(row * mat->width) + i];
+        int cur = mat->data[(row * mat->stride) + i];
 
         if (cur < poundcake) {
           poundcake = cur;
@@ -162,3 +187,21 @@ int Matrix_min_value_in_row(const Matrix* mat, int row,
 
     return poundcake;
 }
+
+// REQUIRES: mat points to a valid Matrix with width >= 2
+//           seam.size() == Matrix_height(mat)
+//           each element x in seam satisfies 0 <= x < Matrix_width(mat)
+// MODIFIES: *mat
+// EFFECTS:  Removes the element at column seam[r] from every row r by
+//           shifting the rest of that row left in place. The width
+//           shrinks by one; the stride is unchanged and nothing is
+//           allocated.
+void Matrix_remove_vertical_seam(Matrix* mat, const std::vector<int> &seam) {
+  for (int i = 0; i < mat->height; i++) {
+    int* row = &mat->data[i * mat->stride];
+    int tail = mat->width - 1 - seam[i];
+    std::memmove(row + seam[i], row + seam[i] + 1, tail * sizeof(int));
+  }
+
+  mat->width--;
+}
@@ -8,22 +8,35 @@
 
 #include <iostream>
 #include <vector>
+#include "memory.hpp"
 
 // Representation of a 2D matrix of integers
 // Matrix objects may be copied.
+// Rows are stored stride elements apart. stride starts out equal to width
+// and stays fixed when columns are removed, so a row can be compacted in
+// place without moving any of the other rows.
 struct Matrix {
   int width;
   int height;
-  std::vector<int> data;
+  int stride;
+  Tracked_Vector<int> data;
 };
 
 // REQUIRES: mat points to a Matrix
 //           0 < width && 0 < height
 // MODIFIES: *mat
 // EFFECTS:  Initializes *mat as a Matrix with the given width and height,
-//           with all elements initialized to 0.
+//           with all elements initialized to 0. The stride is set to width.
 void Matrix_init(Matrix* mat, int width, int height);
 
+// REQUIRES: mat points to a Matrix
+//           0 < width && 0 < height
+// MODIFIES: *mat
+// EFFECTS:  Like Matrix_init, but the elements are left unspecified, for
+//           callers that overwrite all of them. Nothing is allocated if
+//           *mat already had room for width * height elements.
+void Matrix_reshape(Matrix* mat, int width, int height);
+
 // REQUIRES: mat points to a valid Matrix
 // MODIFIES: os
 // EFFECTS:  First, prints the width and height for the Matrix to os:
@@ -99,4 +112,14 @@ int Matrix_column_of_min_value_in_row(const Matrix* mat, int row,
 int Matrix_min_value_in_row(const Matrix* mat, int row,
                             int column_start, int column_end);
 
+// REQUIRES: mat points to a valid Matrix with width >= 2
+//           seam.size() == Matrix_height(mat)
+//           each element x in seam satisfies 0 <= x < Matrix_width(mat)
+// MODIFIES: *mat
+// EFFECTS:  Removes the element at column seam[r] from every row r by
+//           shifting the rest of that row left in place. The width
+//           shrinks by one; the stride is unchanged and nothing is
+//           allocated.
+void Matrix_remove_vertical_seam(Matrix* mat, const std::vector<int> &seam);
+
 #endif // MATRIX_HPP
@@ -0,0 +1,182 @@
+#include "ThreadPool.hpp"
+
+// Hands out the next iteration for thread self, or returns false if
+// there are none left. Called with the pool's mutex held.
+static bool next_iteration(ThreadPool* pool, int self, int* i) {
+  if (!pool->stealing) {
+    if (pool->next >= pool->count) {
+      return false;
+    }
+    *i = pool->next++;
+    return true;
+  }
+
+  if (pool->first[self] == pool->last[self]) {
+    int victim = -1;
+    int most = 0;
+    for (int t = 0; t < pool->size; t++) {
+      if (pool->last[t] - pool->first[t] > most) {
+        most = pool->last[t] - pool->first[t];
+        victim = t;
+      }
+    }
+    if (victim < 0) {
+      return false;
+    }
+    // the victim keeps the first half, which it is working towards
+    int middle = pool->last[victim] - most / 2;
+    if (most == 1) {
+      middle = pool->first[victim];
+    }
+    pool->first[self] = middle;
+    pool->last[self] = pool->last[victim];
+    pool->last[victim] = middle;
+  }
+
+  *i = pool->first[self]++;
+  return true;
+}
+
+// Runs iterations of the current loop until there are none left to hand
+// out. Called with lock held; returns with it held.
+static void work_on_loop(ThreadPool* pool, int self,
+                         std::unique_lock<std::mutex>& lock) {
+  int i;
+  while (next_iteration(pool, self, &i)) {
+    const std::function<void(int)>* task = pool->task;
+
+    lock.unlock();
+    (*task)(i);
+    lock.lock();
+
+    if (++pool->finished == pool->count) {
+      pool->work_done.notify_all();
+    }
+  }
+}
+
+static void worker_main(ThreadPool* pool, int self) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  unsigned long seen = pool->generation;
+
+  for (;;) {
+    pool->work_ready.wait(lock, [&] {
+      return pool->stopping || pool->generation != seen;
+    });
+    if (pool->stopping) {
+      return;
+    }
+    seen = pool->generation;
+    work_on_loop(pool, self, lock);
+  }
+}
+
+// REQUIRES: pool points to a ThreadPool
+//           0 < size
+// MODIFIES: *pool
+// EFFECTS:  Initializes the pool and starts size - 1 worker threads.
+void ThreadPool_init(ThreadPool* pool, int size) {
+  pool->size = size;
+  pool->task = nullptr;
+  pool->count = 0;
+  pool->next = 0;
+  pool->finished = 0;
+  pool->generation = 0;
+  pool->stopping = false;
+  pool->stealing = false;
+  pool->first.assign(size, 0);
+  pool->last.assign(size, 0);
+
+  for (int i = 1; i < size; i++) {
+    pool->workers.emplace_back(worker_main, pool, i);
+  }
+}
+
+// REQUIRES: pool points to an initialized ThreadPool
+// MODIFIES: *pool
+// EFFECTS:  Stops and joins the worker threads.
+void ThreadPool_destroy(ThreadPool* pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stopping = true;
+  }
+  pool->work_ready.notify_all();
+
+  for (std::thread& worker : pool->workers) {
+    worker.join();
+  }
+  pool->workers.clear();
+}
+
+// REQUIRES: pool points to an initialized ThreadPool
+// EFFECTS:  Returns the number of threads (including the caller) that
+//           ThreadPool_run uses.
+int ThreadPool_size(const ThreadPool* pool) {
+  return pool->size;
+}
+
+// Starts the loop on the workers, works on it from the calling thread
+// and waits for the stragglers.
+static void run_loop(ThreadPool* pool, int count,
+                     const std::function<void(int)>& task, bool stealing) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  pool->task = &task;
+  pool->count = count;
+  pool->next = 0;
+  pool->finished = 0;
+  pool->stealing = stealing;
+  if (stealing) {
+    for (int t = 0; t < pool->size; t++) {
+      pool->first[t] = static_cast<int>(static_cast<long long>(count) * t / pool->size);
+      pool->last[t] = static_cast<int>(static_cast<long long>(count) * (t + 1) / pool->size);
+    }
+  }
+  pool->generation++;
+  pool->work_ready.notify_all();
+
+  work_on_loop(pool, 0, lock);
+  pool->work_done.wait(lock, [&] { return pool->finished == pool->count; });
+  pool->task = nullptr;
+}
+
+// REQUIRES: pool points to an initialized ThreadPool
+//           0 <= count
+//           no other call to ThreadPool_run on this pool is in progress
+// EFFECTS:  Calls task(i) for every i in [0, count), spread over the
+//           pool's threads, and returns once all of the calls are done.
+void ThreadPool_run(ThreadPool* pool, int count,
+                    const std::function<void(int)>& task) {
+  if (count <= 0) {
+    return;
+  }
+  if (pool->workers.empty() || count == 1) {
+    for (int i = 0; i < count; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  run_loop(pool, count, task, false);
+}
+
+// REQUIRES: pool points to an initialized ThreadPool
+//           0 <= count
+//           no other call to ThreadPool_run on this pool is in progress
+// EFFECTS:  Same as ThreadPool_run, but meant for a few long iterations of
+//           uneven length. Each thread starts with its own contiguous
+//           share of the iterations; a thread that runs out takes over
+//           the second half of what is left of the busiest thread's share.
+void ThreadPool_run_stealing(ThreadPool* pool, int count,
+                             const std::function<void(int)>& task) {
+  if (count <= 0) {
+    return;
+  }
+  if (pool->workers.empty() || count == 1) {
+    for (int i = 0; i < count; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  run_loop(pool, count, task, true);
+}
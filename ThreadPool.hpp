@@ -0,0 +1,75 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+/* ThreadPool.hpp
+ * A small fixed-size pool of worker threads for data-parallel loops.
+ */
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A set of worker threads that run the iterations of a parallel loop.
+// The thread that calls ThreadPool_run also works on the loop, so a pool
+// of size n has n - 1 worker threads.
+// ThreadPool objects must not be copied.
+struct ThreadPool {
+  int size;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+
+  // the loop being run, protected by mutex
+  const std::function<void(int)>* task;
+  int count;
+  int next;
+  int finished;
+  unsigned long generation;
+  bool stopping;
+
+  // for ThreadPool_run_stealing: the iterations [first[t], last[t]) that
+  // thread t (0 is the caller) still has to run
+  bool stealing;
+  std::vector<int> first;
+  std::vector<int> last;
+};
+
+// REQUIRES: pool points to a ThreadPool
+//           0 < size
+// MODIFIES: *pool
+// EFFECTS:  Initializes the pool and starts size - 1 worker threads.
+void ThreadPool_init(ThreadPool* pool, int size);
+
+// REQUIRES: pool points to an initialized ThreadPool
+// MODIFIES: *pool
+// EFFECTS:  Stops and joins the worker threads.
+void ThreadPool_destroy(ThreadPool* pool);
+
+// REQUIRES: pool points to an initialized ThreadPool
+// EFFECTS:  Returns the number of threads (including the caller) that
+//           ThreadPool_run uses.
+int ThreadPool_size(const ThreadPool* pool);
+
+// REQUIRES: pool points to an initialized ThreadPool
+//           0 <= count
+//           no other call to ThreadPool_run on this pool is in progress
+// EFFECTS:  Calls task(i) for every i in [0, count), spread over the
+//           pool's threads, and returns once all of the calls are done.
+void ThreadPool_run(ThreadPool* pool, int count,
+                    const std::function<void(int)>& task);
+
+// REQUIRES: pool points to an initialized ThreadPool
+//           0 <= count
+//           no other call to ThreadPool_run on this pool is in progress
+// EFFECTS:  Same as ThreadPool_run, but meant for a few long iterations of
+//           uneven length. Each thread starts with its own contiguous
+//           share of the iterations; a thread that runs out takes over
+//           the second half of what is left of the busiest thread's share.
+void ThreadPool_run_stealing(ThreadPool* pool, int count,
+                             const std::function<void(int)>& task);
+
+#endif // THREADPOOL_HPP
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include "band.hpp"
+#include "processing.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+// Marks band cells that no seam inside the band can reach.
+static const int UNREACHABLE = INT_MAX;
+
+// REQUIRES: band points to a Seam_Band, 0 < height && 0 < stride
+// MODIFIES: *band
+// EFFECTS:  Sizes band for views of the given height and rows of at most
+//           stride columns. Memory already held by band is reused.
+void Seam_Band_init(Seam_Band* band, int height, int stride) {
+  band->lo.resize(height);
+  band->hi.resize(height);
+  band->stride = stride;
+  band->energy.resize(static_cast<size_t>(stride) * height);
+  band->cost.resize(static_cast<size_t>(stride) * height);
+}
+
+// REQUIRES: view points to a valid Image_View, band was initialized for
+//           its height, every row of band is inside the view
+// MODIFIES: band->energy
+// EFFECTS:  Computes the energies of the band cells. Interior pixels get
+//           their exact energy; pixels on the border of the view get
+//           border.
+void Seam_Band_energy(const Image_View* view, Seam_Band* band, int border) {
+  PROFILE_SCOPE(PROFILE_ENERGY_UPDATE, 0);
+  const int width = Image_View_width(view);
+  const int height = Image_View_height(view);
+  long long cells = 0;
+
+  vector<int> &row = band->row;
+  row.resize(width);
+  for (int r = 0; r < height; r++) {
+    const int lo = band->lo[r];
+    const int hi = band->hi[r];
+    int* out = &band->energy[r * band->stride];
+    cells += hi - lo + 1;
+
+    if (r == 0 || r == height - 1) {
+      fill(out, out + (hi - lo + 1), border);
+      continue;
+    }
+
+    const int first = max(1, lo);
+    const int last = min(width - 2, hi);
+    if (first <= last) {
+      compute_energy_row_view(view, r, first, last, row.data());
+    }
+    for (int j = lo; j <= hi; j++) {
+      out[j - lo] = (j == 0 || j == width - 1) ? border : row[j];
+    }
+  }
+  PROFILE_BYTES(Image_channels(view->img) * cells);
+  (void)cells;
+}
+
+// REQUIRES: band holds the energies of a width x height view
+// MODIFIES: band->cost
+// EFFECTS:  Fills in the band's costs the way compute_vertical_cost_matrix
+//           does, treating cells outside the band as unreachable. Returns
+//           false if no cell in the last row can be reached.
+bool Seam_Band_cost(Seam_Band* band, int width, int height) {
+  PROFILE_SCOPE(PROFILE_COST_UPDATE, 0);
+  long long cells = band->hi[0] - band->lo[0] + 1;
+
+  for (int j = band->lo[0]; j <= band->hi[0]; j++) {
+    band->cost[j - band->lo[0]] = band->energy[j - band->lo[0]];
+  }
+
+  bool reachable = true;
+  for (int r = 1; r < height; r++) {
+    const int lo = band->lo[r];
+    const int hi = band->hi[r];
+    const int prevLo = band->lo[r - 1];
+    const int prevHi = band->hi[r - 1];
+    const int* prev = &band->cost[(r - 1) * band->stride];
+    const int* e = &band->energy[r * band->stride];
+    int* out = &band->cost[r * band->stride];
+    cells += hi - lo + 1;
+
+    reachable = false;
+    for (int j = lo; j <= hi; j++) {
+      // the same window as compute_vertical_cost_matrix, clipped to the
+      // band of the row above
+      int left = max(0, j - 1);
+      int right = max(left + 1, min(width - 1, j + 2));
+      left = max(left, prevLo);
+      right = min(right, prevHi + 1);
+
+      int best = UNREACHABLE;
+      for (int k = left; k < right; k++) {
+        best = min(best, prev[k - prevLo]);
+      }
+      out[j - lo] = best == UNREACHABLE ? UNREACHABLE : e[j - lo] + best;
+      reachable = reachable || best != UNREACHABLE;
+    }
+    if (!reachable) {
+      break;
+    }
+  }
+
+  PROFILE_BYTES(static_cast<long long>(sizeof(int)) * cells);
+  (void)cells;
+  return reachable;
+}
+
+// REQUIRES: Seam_Band_cost returned true for band
+// MODIFIES: *seam
+// EFFECTS:  Sets *seam to the cheapest seam inside the band, traced back
+//           through its costs and breaking ties to the left like
+//           find_minimal_vertical_seam.
+void Seam_Band_seam(const Seam_Band* band, int width, int height,
+                    vector<int>* seam) {
+  PROFILE_SCOPE(PROFILE_SEAM, 3LL * sizeof(int) * height);
+  seam->resize(height);
+
+  auto cheapest = [&](int r, int left, int right) {
+    const int* costs = &band->cost[r * band->stride];
+    int best = left;
+    for (int j = left + 1; j <= right; j++) {
+      if (costs[j - band->lo[r]] < costs[best - band->lo[r]]) {
+        best = j;
+      }
+    }
+    return best;
+  };
+
+  (*seam)[height - 1] = cheapest(height - 1, band->lo[height - 1], band->hi[height - 1]);
+  for (int r = height - 2; r >= 0; r--) {
+    int left = max(band->lo[r], max(0, (*seam)[r + 1] - 1));
+    int right = min(band->hi[r], min(width - 1, (*seam)[r + 1] + 1));
+    (*seam)[r] = cheapest(r, left, right);
+  }
+}
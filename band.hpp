@@ -0,0 +1,56 @@
+#ifndef BAND_HPP
+#define BAND_HPP
+
+/* band.hpp
+ * A seam search restricted to a few columns of each row. When there is a
+ * good guess of where a seam runs, such as a seam found on a smaller copy
+ * of the image or in the previous frame of a video, only a narrow band
+ * around the guess needs energies and costs.
+ */
+
+#include <vector>
+#include "image_view.hpp"
+
+// A seam search restricted to columns [lo[r], hi[r]] of each row r.
+// Energies and costs are stored per row, relative to lo[r], in rows of
+// stride cells, so no row of the band may be wider than stride. row is
+// scratch space for the energies of one row of the view.
+struct Seam_Band {
+  std::vector<int> lo;
+  std::vector<int> hi;
+  int stride;
+  std::vector<int> energy;
+  std::vector<int> cost;
+  std::vector<int> row;
+};
+
+// REQUIRES: band points to a Seam_Band, 0 < height && 0 < stride
+// MODIFIES: *band
+// EFFECTS:  Sizes band for views of the given height and rows of at most
+//           stride columns. Memory already held by band is reused.
+void Seam_Band_init(Seam_Band* band, int height, int stride);
+
+// REQUIRES: view points to a valid Image_View, band was initialized for
+//           its height, every row of band is inside the view
+// MODIFIES: band->energy
+// EFFECTS:  Computes the energies of the band cells. Interior pixels get
+//           their exact energy; pixels on the border of the view get
+//           border.
+void Seam_Band_energy(const Image_View* view, Seam_Band* band, int border);
+
+// REQUIRES: band holds the energies of a width x height view
+// MODIFIES: band->cost
+// EFFECTS:  Fills in the band's costs the way compute_vertical_cost_matrix
+//           does, treating cells outside the band as unreachable. Returns
+//           false if no cell in the last row can be reached.
+bool Seam_Band_cost(Seam_Band* band, int width, int height);
+
+// REQUIRES: Seam_Band_cost returned true for band
+// MODIFIES: *seam
+// EFFECTS:  Sets *seam to the cheapest seam inside the band, traced back
+//           through its costs and breaking ties to the left like
+//           find_minimal_vertical_seam.
+void Seam_Band_seam(const Seam_Band* band, int width, int height,
+                    std::vector<int>* seam);
+
+#endif // BAND_HPP
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "compact.hpp"
+#include "crop.hpp"
+#include "Image.hpp"
+#include "Matrix.hpp"
+#include "processing.hpp"
+#include "pyramid.hpp"
+#include "seam_index.hpp"
+#include "sequence.hpp"
+#include "energy_kernels.hpp"
+
+// Microbenchmarks for the processing stages and the PPM I/O. Every stage
+// runs on synthetic images and prints one JSON object per line:
+//
+//   {"stage": "...", "content": "noise", "channels": 3, "width": 1920,
+//    "height": 1080, "iterations": 12, "seconds": 0.0041,
+//    "pixels_per_second": 5.0e8, "allocations": 3,
+//    "allocated_bytes": 8294400}
+//
+// seconds, allocations and allocated_bytes are per iteration. Only the
+// timed part of an iteration counts; preparing its input does not. A
+// stage may add fields of its own, such as how far crop_square_proxy's
+// center is from the exact one. A stage may also check its result, such
+// as that seam_carver_steady allocates nothing; bench prints any check
+// that fails to stderr and exits with status 1.
+
+using namespace std;
+
+// Every allocation made through operator new, for the allocation counts.
+static atomic<long long> allocation_count(0);
+static atomic<long long> allocation_bytes(0);
+
+// GCC sees these replacements inlined and warns that memory from
+// operator new is released with free, which is exactly what they do.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+  allocation_count.fetch_add(1, memory_order_relaxed);
+  allocation_bytes.fetch_add(size, memory_order_relaxed);
+  if (void* p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// Settings from the command line.
+struct Bench_Options {
+  int width;
+  int height;
+  vector<string> contents;
+  string only;
+  double minSeconds;
+  int carvePercent;
+  int threads;
+  unsigned seed;
+  int channels;
+  int proxy;
+};
+
+// One benchmark: prepare sets up the input of an iteration (not timed),
+// run is the timed part. report, if set, returns extra fields for the
+// stage's line, each starting with ", ". check, if set, is given the
+// allocations per iteration after the last one and returns what is wrong
+// with the stage's result, or an empty string if nothing is.
+struct Bench_Stage {
+  string name;
+  function<void()> prepare;
+  function<void()> run;
+  function<string()> report = nullptr;
+  function<string(long long)> check = nullptr;
+};
+
+static void print_usage() {
+  cout << "Usage: bench [--size WIDTHxHEIGHT] [--content noise|gradient|subject|all]\n"
+       << "             [--stage NAME] [--min-time SECONDS] [--carve PERCENT]\n"
+       << "             [--threads N] [--seed N] [--channels 1|3] [--proxy FACTOR]\n"
+       << "Prints one JSON line per stage and image content" << endl;
+}
+
+// Fills img with uniformly random pixels.
+static void make_noise(Image* img, int width, int height, int channels,
+                       unsigned seed) {
+  Image_init(img, width, height, channels);
+  mt19937 rng(seed);
+  for (int ch = 0; ch < channels; ch++) {
+    for (int r = 0; r < height; r++) {
+      unsigned char* row = Image_row(img, ch, r);
+      for (int c = 0; c < width; c++) {
+        row[c] = static_cast<unsigned char>(rng() >> 24);
+      }
+    }
+  }
+}
+
+// Fills img with smooth gradients: red across, green down and blue along
+// the diagonal. A gray image gets the diagonal one.
+static void make_gradient(Image* img, int width, int height, int channels) {
+  Image_init(img, width, height, channels);
+  if (channels == 1) {
+    for (int r = 0; r < height; r++) {
+      unsigned char* gray = Image_row(img, 0, r);
+      for (int c = 0; c < width; c++) {
+        gray[c] = static_cast<unsigned char>((c + r) * 255L / max(1, width + height - 2));
+      }
+    }
+    return;
+  }
+  for (int r = 0; r < height; r++) {
+    unsigned char* red = Image_row(img, 0, r);
+    unsigned char* green = Image_row(img, 1, r);
+    unsigned char* blue = Image_row(img, 2, r);
+    for (int c = 0; c < width; c++) {
+      red[c] = static_cast<unsigned char>(c * 255L / max(1, width - 1));
+      green[c] = static_cast<unsigned char>(r * 255L / max(1, height - 1));
+      blue[c] = static_cast<unsigned char>((c + r) * 255L / max(1, width + height - 2));
+    }
+  }
+}
+
+// Fills img with a smooth gradient and, somewhere in it, a square of
+// noise a quarter of the image across, like a detailed subject on a plain
+// background.
+static void make_subject(Image* img, int width, int height, int channels,
+                         unsigned seed) {
+  make_gradient(img, width, height, channels);
+  mt19937 rng(seed);
+  const int side = max(1, min(width, height) / 4);
+  const int top = static_cast<int>(rng() % (height - side + 1));
+  const int left = static_cast<int>(rng() % (width - side + 1));
+  for (int ch = 0; ch < channels; ch++) {
+    for (int r = top; r < top + side; r++) {
+      unsigned char* row = Image_row(img, ch, r);
+      for (int c = left; c < left + side; c++) {
+        row[c] = static_cast<unsigned char>(rng() >> 24);
+      }
+    }
+  }
+}
+
+// Reduces the width of img to newWidth like seam_carve_width, but
+// recomputes the full energy and cost matrices for every seam. Much
+// slower; kept as the reference seam_carve_width must match.
+static void seam_carve_width_full(Image *img, int newWidth) {
+  int runs = Image_width(img) - newWidth;
+
+  Matrix opEnergy;
+  Matrix opCost;
+  vector<int> opSeam;
+
+  for (int i = 0; i < runs; i++) {
+    compute_energy_matrix(img, &opEnergy);
+    compute_vertical_cost_matrix(&opEnergy, &opCost);
+    opSeam = find_minimal_vertical_seam(&opCost);
+    remove_vertical_seam(img, opSeam);
+  }
+}
+
+// Returns true if a and b have the same size, channels and pixels.
+static bool same_pixels(const Image* a, const Image* b) {
+  if (Image_width(a) != Image_width(b) || Image_height(a) != Image_height(b) ||
+      Image_channels(a) != Image_channels(b)) {
+    return false;
+  }
+  for (int ch = 0; ch < Image_channels(a); ch++) {
+    for (int r = 0; r < Image_height(a); r++) {
+      if (!equal(Image_row(a, ch, r), Image_row(a, ch, r) + Image_width(a),
+                 Image_row(b, ch, r))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Runs stage until at least minSeconds of timed work have been done and
+// prints its line. Returns false if the stage's check failed.
+static bool run_stage(const Bench_Stage &stage, const string &content,
+                      const Image* source, double minSeconds) {
+  double seconds = 0;
+  long long allocations = 0;
+  long long bytes = 0;
+  int iterations = 0;
+
+  while (iterations == 0 || seconds < minSeconds) {
+    stage.prepare();
+
+    long long count0 = allocation_count.load();
+    long long bytes0 = allocation_bytes.load();
+    auto start = chrono::steady_clock::now();
+    stage.run();
+    auto stop = chrono::steady_clock::now();
+    allocations += allocation_count.load() - count0;
+    bytes += allocation_bytes.load() - bytes0;
+
+    seconds += chrono::duration<double>(stop - start).count();
+    iterations++;
+  }
+
+  double perIteration = seconds / iterations;
+  double pixels = static_cast<double>(Image_width(source)) * Image_height(source);
+  cout << "{\"stage\": \"" << stage.name << "\", \"content\": \"" << content
+       << "\", \"channels\": " << Image_channels(source)
+       << ", \"width\": " << Image_width(source)
+       << ", \"height\": " << Image_height(source)
+       << ", \"iterations\": " << iterations
+       << ", \"seconds\": " << perIteration
+       << ", \"pixels_per_second\": " << pixels / perIteration
+       << ", \"allocations\": " << allocations / iterations
+       << ", \"allocated_bytes\": " << bytes / iterations
+       << (stage.report ? stage.report() : "") << "}" << endl;
+
+  const string problem = stage.check ? stage.check(allocations / iterations) : "";
+  if (!problem.empty()) {
+    cerr << stage.name << " (" << content << "): " << problem << endl;
+    return false;
+  }
+  return true;
+}
+
+// Benchmarks every stage on one source image. Returns the number of
+// stages whose check failed.
+static int bench_image(const Image* source, const string &content,
+                       const Bench_Options &options) {
+  // inputs and outputs shared by the stages; each stage's prepare step
+  // puts them in the state its run step expects
+  Image img;
+  Image out;
+  Matrix energy;
+  Matrix cost;
+  vector<int> seam;
+  string encoded;
+  Seam_Index index;
+  bool indexBuilt = false;
+  SeamCarver carver;
+  bool carverWarm = false;
+  Seam_Steps steps;
+  Compact_Matrix compactEnergy;
+  Compact_Matrix compactCost;
+  SeamCarver compactCarver;
+  compactCarver.precision = CARVE_PRECISION_16;
+  SeamCarver lumaCarver;
+  lumaCarver.source = ENERGY_SOURCE_LUMA;
+  Sequence_Carver sequenceCarver;
+  bool sequenceWarm = false;
+  int exactRow = 0;
+  int exactColumn = 0;
+  find_max_energy_pixel_proxy(source, 1, &exactRow, &exactColumn);
+
+  compute_energy_matrix(source, &energy);
+  compute_vertical_cost_matrix(&energy, &cost);
+  const vector<int> sourceSeam = find_minimal_vertical_seam(&cost);
+  Matrix horizontalEnergy;
+  Matrix horizontalCost;
+  compute_horizontal_energy_matrix(source, &horizontalEnergy);
+  compute_vertical_cost_matrix(&horizontalEnergy, &horizontalCost);
+  const vector<int> sourceRowSeam = find_minimal_horizontal_seam(&horizontalCost);
+
+  const int carveWidth = max(1, Image_width(source) * (100 - options.carvePercent) / 100);
+  const int carveHeight = max(1, Image_height(source) * (100 - options.carvePercent) / 100);
+
+  auto copySource = [&]() { img = *source; };
+  auto nothing = []() {};
+  auto encode = [&](PPM_Format f) {
+    return [&, f]() {
+      ostringstream os;
+      Image_write(source, os, f);
+      encoded = os.str();
+    };
+  };
+
+  vector<Bench_Stage> stages = {
+    { "compute_energy_matrix", nothing,
+      [&]() { compute_energy_matrix(source, &energy); } },
+    { "compute_horizontal_energy_matrix", nothing,
+      [&]() { compute_horizontal_energy_matrix(source, &energy); } },
+    { "compute_vertical_cost_matrix",
+      [&]() { compute_energy_matrix(source, &energy); },
+      [&]() { compute_vertical_cost_matrix(&energy, &cost); } },
+    { "find_minimal_vertical_seam_by_steps",
+      [&]() { compute_energy_matrix(source, &energy); },
+      [&]() { find_minimal_vertical_seam_by_steps(&energy, &steps, &seam); } },
+    { "compute_compact_cost_matrix",
+      [&]() { compute_energy_matrix(source, &energy);
+              Compact_Matrix_narrow(&compactEnergy, &energy); },
+      [&]() { compute_compact_cost_matrix(&compactEnergy, &compactCost); } },
+    { "find_minimal_vertical_seam",
+      [&]() { compute_energy_matrix(source, &energy);
+              compute_vertical_cost_matrix(&energy, &cost); },
+      [&]() { seam = find_minimal_vertical_seam(&cost); } },
+    { "remove_vertical_seam", copySource,
+      [&]() { remove_vertical_seam(&img, sourceSeam); } },
+    { "remove_horizontal_seam", copySource,
+      [&]() { remove_horizontal_seam(&img, sourceRowSeam); } },
+    { "rotate_left", copySource, [&]() { rotate_left(&img); } },
+    { "rotate_right", copySource, [&]() { rotate_right(&img); } },
+    { "crop_square_centered_at_max_energy", nothing,
+      [&]() { crop_square_centered_at_max_energy(source, &out); } },
+    // the proxy crop's center against the exact one: how far it is, and
+    // how much of the exact crop the proxy crop covers
+    { "crop_square_proxy", nothing,
+      [&]() { crop_square_centered_at_max_energy_proxy(source, &out, options.proxy); },
+      [&]() {
+        int row = 0;
+        int column = 0;
+        find_max_energy_pixel_proxy(source, options.proxy, &row, &column);
+        int exactTop, exactLeft, top, left, side;
+        crop_square_around(Image_width(source), Image_height(source), exactRow,
+                           exactColumn, &exactTop, &exactLeft, &side);
+        crop_square_around(Image_width(source), Image_height(source), row, column,
+                           &top, &left, &side);
+        const double overlap = static_cast<double>(max(0, side - abs(top - exactTop))) *
+                               max(0, side - abs(left - exactLeft)) / (side * side);
+        ostringstream fields;
+        fields << ", \"proxy_factor\": " << options.proxy
+               << ", \"center_distance\": " << hypot(row - exactRow, column - exactColumn)
+               << ", \"crop_overlap\": " << overlap;
+        return fields.str();
+      } },
+    { "crop_max_energy_window", nothing,
+      [&]() { crop_max_energy_window(source, &out, 512, 512); } },
+    { "seam_carve_width", copySource,
+      [&]() { seam_carve_width(&img, carveWidth); } },
+    // the reference: seam_carve_width only updates what each seam changed,
+    // and must still give exactly the same image as recomputing everything
+    { "seam_carve_width_full", copySource,
+      [&]() { seam_carve_width_full(&img, carveWidth); },
+      nullptr,
+      [&](long long) {
+        Image expected = *source;
+        seam_carve_width(&expected, carveWidth);
+        return same_pixels(&img, &expected) ? string()
+                                            : string("differs from seam_carve_width");
+      } },
+    { "seam_carve_height", copySource,
+      [&]() { seam_carve_height(&img, carveHeight); } },
+    { "seam_carve_width_pyramid", copySource,
+      [&]() { Pyramid_Options pyramid = { 2, 0 };
+              seam_carve_width_pyramid(&img, carveWidth, pyramid); } },
+    { "seam_carve_height_pyramid", copySource,
+      [&]() { Pyramid_Options pyramid = { 2, 0 };
+              seam_carve_height_pyramid(&img, carveHeight, pyramid); } },
+    { "seam_index_apply",
+      [&]() { if (!indexBuilt) { Seam_Index_init(&index, source); indexBuilt = true; } },
+      [&]() { Seam_Index_apply(&index, source, &out, carveWidth); } },
+    // the carver is kept between iterations and warmed up once, so this
+    // measures the steady state, which must allocate nothing
+    { "seam_carver_steady",
+      [&]() { if (!carverWarm) { img = *source;
+                                 SeamCarver_carve(&carver, &img, carveWidth, carveHeight);
+                                 carverWarm = true; }
+              img = *source; },
+      [&]() { SeamCarver_carve(&carver, &img, carveWidth, carveHeight); },
+      nullptr,
+      [](long long allocations) {
+        return allocations == 0 ? string()
+                                : to_string(allocations) + " allocations in the steady state";
+      } },
+    { "seam_carve_compact", copySource,
+      [&]() { SeamCarver_carve(&compactCarver, &img, carveWidth, carveHeight); } },
+    { "seam_carve_luma", copySource,
+      [&]() { SeamCarver_carve(&lumaCarver, &img, carveWidth, carveHeight); } },
+    // every iteration is the next frame of a still video, carved in bands
+    // around the seams of the one before
+    { "sequence_carve_width",
+      [&]() { if (!sequenceWarm) { Sequence_Carver_init(&sequenceCarver, { 0, 0 });
+                                   img = *source;
+                                   Sequence_Carver_carve_width(&sequenceCarver, &img, carveWidth);
+                                   sequenceWarm = true; }
+              img = *source; },
+      [&]() { Sequence_Carver_carve_width(&sequenceCarver, &img, carveWidth); } },
+    { "seam_carve", copySource,
+      [&]() { seam_carve(&img, carveWidth, carveHeight); } },
+    { "ppm_write_p3", nothing,
+      [&]() { ostringstream os; Image_write(source, os, PPM_P3); } },
+    { "ppm_write_p6", nothing,
+      [&]() { ostringstream os; Image_write(source, os, PPM_P6); } },
+    { "ppm_write_p5", nothing,
+      [&]() { ostringstream os; Image_write(source, os, PPM_P5); } },
+    { "ppm_read_p3", encode(PPM_P3),
+      [&]() { istringstream is(encoded); string error; Image_read(&img, is, &error); } },
+    { "ppm_read_p6", encode(PPM_P6),
+      [&]() { istringstream is(encoded); string error; Image_read(&img, is, &error); } },
+    { "ppm_read_p5", encode(PPM_P5),
+      [&]() { istringstream is(encoded); string error; Image_read(&img, is, &error); } },
+  };
+
+  int failed = 0;
+  for (const Bench_Stage &stage : stages) {
+    if (options.only.empty() || options.only == stage.name) {
+      failed += !run_stage(stage, content, source, options.minSeconds);
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  Bench_Options options = { 1920, 1080, { "noise", "gradient" }, "", 0.5, 10, 1, 1,
+                            IMAGE_CHANNELS, 4 };
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      print_usage();
+      return 1;
+    }
+    string value = argv[++i];
+    if (arg == "--size") {
+      if (sscanf(value.c_str(), "%dx%d", &options.width, &options.height) != 2 ||
+          options.width < 1 || options.height < 1) {
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--content") {
+      if (value == "all") {
+        options.contents = { "noise", "gradient", "subject" };
+      } else if (value == "noise" || value == "gradient" || value == "subject") {
+        options.contents = { value };
+      } else {
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--stage") {
+      options.only = value;
+    } else if (arg == "--min-time") {
+      options.minSeconds = atof(value.c_str());
+    } else if (arg == "--carve") {
+      options.carvePercent = atoi(value.c_str());
+      if (options.carvePercent < 0 || options.carvePercent > 99) {
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--threads") {
+      options.threads = max(1, atoi(value.c_str()));
+    } else if (arg == "--seed") {
+      options.seed = static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10));
+    } else if (arg == "--channels") {
+      if (value != "1" && value != "3") {
+        print_usage();
+        return 1;
+      }
+      options.channels = atoi(value.c_str());
+    } else if (arg == "--proxy") {
+      options.proxy = atoi(value.c_str());
+      if (options.proxy < 1 || options.proxy > CROP_PROXY_MAX_FACTOR) {
+        print_usage();
+        return 1;
+      }
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  set_processing_threads(options.threads);
+  cerr << "energy kernel: " << energy_kernel_name(energy_kernel_current())
+       << ", threads: " << options.threads << endl;
+
+  int failed = 0;
+  for (const string &content : options.contents) {
+    Image source;
+    if (content == "noise") {
+      make_noise(&source, options.width, options.height, options.channels,
+                 options.seed);
+    } else if (content == "gradient") {
+      make_gradient(&source, options.width, options.height, options.channels);
+    } else {
+      make_subject(&source, options.width, options.height, options.channels,
+                   options.seed);
+    }
+    failed += bench_image(&source, content, options);
+  }
+  return failed == 0 ? 0 : 1;
+}
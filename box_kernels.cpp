@@ -0,0 +1,82 @@
+#include "box_kernels.hpp"
+#include "energy_kernels.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BOX_HAVE_X86 1
+#endif
+
+// The vector kernels widen the bytes to 16-bit lanes by unpacking them
+// with zeros, and add them to the sums.
+
+typedef void (*Box_Kernel)(const unsigned char* row, uint16_t* sums, int width);
+
+static void box_row_scalar(const unsigned char* row, uint16_t* sums, int width) {
+  for (int j = 0; j < width; j++) {
+    sums[j] = static_cast<uint16_t>(sums[j] + row[j]);
+  }
+}
+
+#ifdef BOX_HAVE_X86
+
+__attribute__((target("sse4.1")))
+static void box_row_sse41(const unsigned char* row, uint16_t* sums, int width) {
+  const __m128i zero = _mm_setzero_si128();
+
+  int j = 0;
+  for (; j + 16 <= width; j += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j));
+    __m128i* low = reinterpret_cast<__m128i*>(sums + j);
+    __m128i* high = reinterpret_cast<__m128i*>(sums + j + 8);
+    _mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low),
+                                        _mm_unpacklo_epi8(bytes, zero)));
+    _mm_storeu_si128(high, _mm_add_epi16(_mm_loadu_si128(high),
+                                         _mm_unpackhi_epi8(bytes, zero)));
+  }
+
+  box_row_scalar(row + j, sums + j, width - j);
+}
+
+__attribute__((target("avx2")))
+static void box_row_avx2(const unsigned char* row, uint16_t* sums, int width) {
+  int j = 0;
+  for (; j + 32 <= width; j += 32) {
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j));
+    __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j + 16));
+    __m256i* low = reinterpret_cast<__m256i*>(sums + j);
+    __m256i* high = reinterpret_cast<__m256i*>(sums + j + 16);
+    _mm256_storeu_si256(low, _mm256_add_epi16(_mm256_loadu_si256(low),
+                                              _mm256_cvtepu8_epi16(first)));
+    _mm256_storeu_si256(high, _mm256_add_epi16(_mm256_loadu_si256(high),
+                                               _mm256_cvtepu8_epi16(second)));
+  }
+
+  box_row_scalar(row + j, sums + j, width - j);
+}
+
+#endif // BOX_HAVE_X86
+
+// The kernel matching the selected energy kernel. There is no 512-bit
+// version; the AVX-512 energy kernel pairs with the AVX2 one.
+static Box_Kernel selected_box_kernel() {
+  switch (energy_kernel_current()) {
+#ifdef BOX_HAVE_X86
+  case ENERGY_KERNEL_SSE41:
+    return box_row_sse41;
+  case ENERGY_KERNEL_AVX2:
+  case ENERGY_KERNEL_AVX512:
+    return box_row_avx2;
+#endif
+  default:
+    return box_row_scalar;
+  }
+}
+
+// REQUIRES: row[0 .. width - 1] and sums[0 .. width - 1] are valid
+//           sums[j] + row[j] fits in 16 bits for every j
+// MODIFIES: sums[0 .. width - 1]
+// EFFECTS:  Adds row[j] to sums[j] for each column j.
+void box_accumulate_row(const unsigned char* row, uint16_t* sums, int width) {
+  selected_box_kernel()(row, sums, width);
+}
@@ -0,0 +1,19 @@
+#ifndef BOX_KERNELS_HPP
+#define BOX_KERNELS_HPP
+
+/* box_kernels.hpp
+ * Row kernel for box-filtering an image down: the rows of a block are
+ * added up column by column before the columns are. Vectorized versions
+ * follow the selected energy kernel and give exactly the same results as
+ * the scalar one.
+ */
+
+#include <cstdint>
+
+// REQUIRES: row[0 .. width - 1] and sums[0 .. width - 1] are valid
+//           sums[j] + row[j] fits in 16 bits for every j
+// MODIFIES: sums[0 .. width - 1]
+// EFFECTS:  Adds row[j] to sums[j] for each column j.
+void box_accumulate_row(const unsigned char* row, uint16_t* sums, int width);
+
+#endif // BOX_KERNELS_HPP
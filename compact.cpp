@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <cstring>
+#include "compact.hpp"
+#include "energy_kernels.hpp"
+#include "profile.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define COMPACT_HAVE_X86 1
+#endif
+
+using namespace std;
+
+// REQUIRES: mat points to a Compact_Matrix
+//           0 < width && 0 < height
+// MODIFIES: *mat
+// EFFECTS:  Makes *mat width x height with its stride set to width. The
+//           elements are left unspecified. Nothing is allocated if *mat
+//           already had room for width * height elements.
+void Compact_Matrix_reshape(Compact_Matrix* mat, int width, int height) {
+  mat->width = width;
+  mat->height = height;
+  mat->stride = width;
+  const size_t size = static_cast<size_t>(width) * height;
+  if (mat->data.size() < size) {
+    mat->data.resize(size);
+  }
+}
+
+// REQUIRES: mat points to a valid Compact_Matrix
+//           0 <= row && row < mat->height
+// EFFECTS:  Returns a pointer to the first element of the given row.
+uint16_t* Compact_Matrix_row(Compact_Matrix* mat, int row) {
+  return &mat->data[static_cast<size_t>(row) * mat->stride];
+}
+
+const uint16_t* Compact_Matrix_row(const Compact_Matrix* mat, int row) {
+  return &mat->data[static_cast<size_t>(row) * mat->stride];
+}
+
+// REQUIRES: mat points to a Compact_Matrix, src points to a valid Matrix
+//           every element of src is in [0, COMPACT_SATURATED]
+// MODIFIES: *mat
+// EFFECTS:  Reshapes *mat to the size of src and copies src into it.
+void Compact_Matrix_narrow(Compact_Matrix* mat, const Matrix* src) {
+  Compact_Matrix_reshape(mat, Matrix_width(src), Matrix_height(src));
+  for (int i = 0; i < mat->height; i++) {
+    const int* in = Matrix_at(src, i, 0);
+    uint16_t* out = Compact_Matrix_row(mat, i);
+    for (int j = 0; j < mat->width; j++) {
+      out[j] = static_cast<uint16_t>(in[j]);
+    }
+  }
+}
+
+// REQUIRES: mat points to a valid Compact_Matrix, dst points to a Matrix
+// MODIFIES: *dst
+// EFFECTS:  Reshapes *dst to the size of mat and copies mat into it.
+void Compact_Matrix_widen(const Compact_Matrix* mat, Matrix* dst) {
+  Matrix_reshape(dst, mat->width, mat->height);
+  for (int i = 0; i < mat->height; i++) {
+    const uint16_t* in = Compact_Matrix_row(mat, i);
+    int* out = Matrix_at(dst, i, 0);
+    for (int j = 0; j < mat->width; j++) {
+      out[j] = in[j];
+    }
+  }
+}
+
+// REQUIRES: mat points to a valid Compact_Matrix
+// MODIFIES: *mat
+// EFFECTS:  Sets every element on the border of *mat to value.
+void Compact_Matrix_fill_border(Compact_Matrix* mat, uint16_t value) {
+  uint16_t* first = Compact_Matrix_row(mat, 0);
+  uint16_t* last = Compact_Matrix_row(mat, mat->height - 1);
+  for (int j = 0; j < mat->width; j++) {
+    first[j] = value;
+    last[j] = value;
+  }
+  for (int i = 1; i < mat->height - 1; i++) {
+    uint16_t* row = Compact_Matrix_row(mat, i);
+    row[0] = value;
+    row[mat->width - 1] = value;
+  }
+}
+
+// REQUIRES: mat points to a valid Compact_Matrix with width >= 2
+//           seam.size() == mat->height
+//           0 <= seam[i] && seam[i] < mat->width for every i
+// MODIFIES: *mat
+// EFFECTS:  Removes element seam[i] from each row i, so the width of the
+//           matrix is one less than before.
+void Compact_Matrix_remove_vertical_seam(Compact_Matrix* mat,
+                                         const vector<int> &seam) {
+  for (int i = 0; i < mat->height; i++) {
+    uint16_t* row = Compact_Matrix_row(mat, i);
+    int tail = mat->width - 1 - seam[i];
+    memmove(row + seam[i], row + seam[i] + 1, tail * sizeof(uint16_t));
+  }
+  mat->width--;
+}
+
+// Minimum of prev over the window cost_row in processing.cpp uses for
+// column j: [max(0, j - 1), min(width - 1, j + 2)), or prev[left] if that
+// is empty.
+static inline int window_min(const uint16_t* prev, int width, int j) {
+  int left = max(0, j - 1);
+  int right = min(width - 1, j + 2);
+
+  int best = prev[left];
+  for (int k = left + 1; k < right; k++) {
+    best = min(best, static_cast<int>(prev[k]));
+  }
+  return best;
+}
+
+// Each kernel fills columns [lo, hi] of a cost row, 1 <= lo and
+// hi <= width - 3, where every column sees all three cells above it:
+// out[j] = e[j] + (min(prev[j - 1], prev[j], prev[j + 1]) - prevMin),
+// saturating at COMPACT_SATURATED. prevMin is the minimum of prev, so the
+// subtraction never goes below zero. *rowMin and *rowMax are lowered and
+// raised to cover the values written.
+typedef void (*Cost_Kernel)(const uint16_t* prev, int prevMin,
+                            const uint16_t* e, uint16_t* out, int lo, int hi,
+                            int* rowMin, int* rowMax);
+
+static void cost_row_scalar(const uint16_t* prev, int prevMin,
+                            const uint16_t* e, uint16_t* out, int lo, int hi,
+                            int* rowMin, int* rowMax) {
+  int low = *rowMin;
+  int high = *rowMax;
+  for (int j = lo; j <= hi; j++) {
+    int best = min(min(prev[j - 1], prev[j]), prev[j + 1]);
+    int value = min(e[j] + best - prevMin, COMPACT_SATURATED);
+    out[j] = static_cast<uint16_t>(value);
+    low = min(low, value);
+    high = max(high, value);
+  }
+  *rowMin = low;
+  *rowMax = high;
+}
+
+#ifdef COMPACT_HAVE_X86
+
+// Minimum and maximum of the 8 lanes of low and high, folded into
+// *rowMin and *rowMax. phminposuw finds the minimum; the maximum is the
+// complement of the minimum of the complements.
+__attribute__((target("sse4.1")))
+static void fold_lanes(__m128i low, __m128i high, int* rowMin, int* rowMax) {
+  const __m128i ones = _mm_set1_epi16(-1);
+  int lowest = _mm_extract_epi16(_mm_minpos_epu16(low), 0);
+  int highest = 0xFFFF - _mm_extract_epi16(
+      _mm_minpos_epu16(_mm_xor_si128(high, ones)), 0);
+  *rowMin = min(*rowMin, lowest);
+  *rowMax = max(*rowMax, highest);
+}
+
+__attribute__((target("sse4.1")))
+static void cost_row_sse41(const uint16_t* prev, int prevMin,
+                           const uint16_t* e, uint16_t* out, int lo, int hi,
+                           int* rowMin, int* rowMax) {
+  const __m128i base = _mm_set1_epi16(static_cast<short>(prevMin));
+  __m128i low = _mm_set1_epi16(-1);
+  __m128i high = _mm_setzero_si128();
+
+  int j = lo;
+  for (; j + 8 <= hi + 1; j += 8) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + j - 1));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + j));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + j + 1));
+    __m128i best = _mm_sub_epi16(_mm_min_epu16(_mm_min_epu16(a, b), c), base);
+    __m128i energy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(e + j));
+    __m128i value = _mm_adds_epu16(energy, best);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), value);
+    low = _mm_min_epu16(low, value);
+    high = _mm_max_epu16(high, value);
+  }
+  fold_lanes(low, high, rowMin, rowMax);
+
+  cost_row_scalar(prev, prevMin, e, out, j, hi, rowMin, rowMax);
+}
+
+__attribute__((target("avx2")))
+static void cost_row_avx2(const uint16_t* prev, int prevMin,
+                          const uint16_t* e, uint16_t* out, int lo, int hi,
+                          int* rowMin, int* rowMax) {
+  const __m256i base = _mm256_set1_epi16(static_cast<short>(prevMin));
+  __m256i low = _mm256_set1_epi16(-1);
+  __m256i high = _mm256_setzero_si256();
+
+  int j = lo;
+  for (; j + 16 <= hi + 1; j += 16) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j - 1));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j + 1));
+    __m256i best = _mm256_sub_epi16(_mm256_min_epu16(_mm256_min_epu16(a, b), c), base);
+    __m256i energy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(e + j));
+    __m256i value = _mm256_adds_epu16(energy, best);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), value);
+    low = _mm256_min_epu16(low, value);
+    high = _mm256_max_epu16(high, value);
+  }
+  fold_lanes(_mm_min_epu16(_mm256_castsi256_si128(low),
+                           _mm256_extracti128_si256(low, 1)),
+             _mm_max_epu16(_mm256_castsi256_si128(high),
+                           _mm256_extracti128_si256(high, 1)),
+             rowMin, rowMax);
+
+  cost_row_scalar(prev, prevMin, e, out, j, hi, rowMin, rowMax);
+}
+
+#endif // COMPACT_HAVE_X86
+
+// The kernel matching the selected energy kernel, so benchmarks that pick
+// an instruction set get it for both. There is no 512-bit version; the
+// AVX-512 energy kernel pairs with the AVX2 one.
+static Cost_Kernel selected_cost_kernel() {
+  switch (energy_kernel_current()) {
+#ifdef COMPACT_HAVE_X86
+  case ENERGY_KERNEL_SSE41:
+    return cost_row_sse41;
+  case ENERGY_KERNEL_AVX2:
+  case ENERGY_KERNEL_AVX512:
+    return cost_row_avx2;
+#endif
+  default:
+    return cost_row_scalar;
+  }
+}
+
+// REQUIRES: energy points to a valid Compact_Matrix
+//           cost points to a Compact_Matrix, energy != cost
+// MODIFIES: *cost
+// EFFECTS:  Computes the cost matrix of energy the way
+//           compute_vertical_cost_matrix does, with every row stored
+//           relative to the minimum of the row above it. Returns false if
+//           any cell saturated, in which case the seam must be found with
+//           the 32-bit cost matrix instead. Uses 16-bit vector instructions
+//           when the selected energy kernel does.
+bool compute_compact_cost_matrix(const Compact_Matrix* energy,
+                                 Compact_Matrix* cost) {
+  const int width = energy->width;
+  const int height = energy->height;
+  PROFILE_SCOPE(PROFILE_COST, static_cast<long long>(sizeof(uint16_t)) *
+                               width * height);
+  Compact_Matrix_reshape(cost, width, height);
+  const Cost_Kernel kernel = selected_cost_kernel();
+
+  const uint16_t* first = Compact_Matrix_row(energy, 0);
+  memcpy(Compact_Matrix_row(cost, 0), first, width * sizeof(uint16_t));
+  int prevMin = *min_element(first, first + width);
+
+  // columns 1 .. width - 3 go to the kernel; the few at the edges use the
+  // general window, exactly as in cost_row
+  const int start = 1;
+  const int stop = width - 3;
+  for (int i = 1; i < height; i++) {
+    const uint16_t* prev = Compact_Matrix_row(cost, i - 1);
+    const uint16_t* e = Compact_Matrix_row(energy, i);
+    uint16_t* out = Compact_Matrix_row(cost, i);
+    int rowMin = COMPACT_SATURATED;
+    int rowMax = 0;
+
+    auto edge = [&](int j) {
+      int value = min(e[j] + window_min(prev, width, j) - prevMin,
+                      COMPACT_SATURATED);
+      out[j] = static_cast<uint16_t>(value);
+      rowMin = min(rowMin, value);
+      rowMax = max(rowMax, value);
+    };
+    int j = 0;
+    for (; j < width && j < start; j++) {
+      edge(j);
+    }
+    if (start <= stop) {
+      kernel(prev, prevMin, e, out, start, stop, &rowMin, &rowMax);
+      j = stop + 1;
+    }
+    for (; j < width; j++) {
+      edge(j);
+    }
+
+    // a saturated cell may have lost the difference to its neighbours;
+    // the rows below would inherit that, so stop here
+    if (rowMax == COMPACT_SATURATED) {
+      return false;
+    }
+    prevMin = rowMin;
+  }
+  return true;
+}
+
+// Column of the first minimum of row[left, right).
+static int column_of_min(const uint16_t* row, int left, int right) {
+  return static_cast<int>(min_element(row + left, row + right) - row);
+}
+
+// REQUIRES: cost was filled in by a successful compute_compact_cost_matrix
+//           seam points to a vector
+// MODIFIES: *seam
+// EFFECTS:  Same as find_minimal_vertical_seam on the 32-bit cost matrix
+//           of the same energies, including leftmost-wins ties.
+void find_minimal_compact_seam(const Compact_Matrix* cost, vector<int>* seam) {
+  const int width = cost->width;
+  const int height = cost->height;
+  PROFILE_SCOPE(PROFILE_SEAM, 3LL * sizeof(uint16_t) * height);
+  vector<int> &columns = *seam;
+  columns.resize(height);
+  columns[height - 1] = column_of_min(Compact_Matrix_row(cost, height - 1),
+                                      0, width);
+
+  for (int i = height - 2; i >= 0; i--) {
+    int left = max(0, columns[i + 1] - 1);
+    int right = min(width - 1, columns[i + 1] + 1);
+    columns[i] = column_of_min(Compact_Matrix_row(cost, i), left, right + 1);
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef COMPACT_HPP
+#define COMPACT_HPP
+
+/* compact.hpp
+ * Energy and cost matrices stored as 16-bit unsigned integers, for the
+ * 16-bit carving mode. Energies are at most ENERGY_MAX (3900) and always
+ * fit. Costs do not: they grow by up to ENERGY_MAX per row. Each row of
+ * the cost matrix is therefore stored relative to the minimum of the row
+ * above it, and the additions saturate at COMPACT_SATURATED instead of
+ * wrapping around. Subtracting the same amount from every cell of a row
+ * changes none of the comparisons the seam search makes within that row,
+ * so as long as nothing saturates the seam found is the one the 32-bit
+ * cost matrix gives. A saturated cell is reported, never silently used.
+ */
+
+#include <cstdint>
+#include <vector>
+#include "Matrix.hpp"
+
+// Value of a saturated cost cell. A cell only holds it if the true
+// (relative) cost is at least this large.
+const int COMPACT_SATURATED = 65535;
+
+// A matrix of 16-bit unsigned values, laid out like Matrix: rows are
+// stride elements apart and keep their place when columns are removed.
+struct Compact_Matrix {
+  int width;
+  int height;
+  int stride;
+  Tracked_Vector<uint16_t> data;
+};
+
+// REQUIRES: mat points to a Compact_Matrix
+//           0 < width && 0 < height
+// MODIFIES: *mat
+// EFFECTS:  Makes *mat width x height with its stride set to width. The
+//           elements are left unspecified. Nothing is allocated if *mat
+//           already had room for width * height elements.
+void Compact_Matrix_reshape(Compact_Matrix* mat, int width, int height);
+
+// REQUIRES: mat points to a valid Compact_Matrix
+//           0 <= row && row < mat->height
+// EFFECTS:  Returns a pointer to the first element of the given row.
+uint16_t* Compact_Matrix_row(Compact_Matrix* mat, int row);
+const uint16_t* Compact_Matrix_row(const Compact_Matrix* mat, int row);
+
+// REQUIRES: mat points to a Compact_Matrix, src points to a valid Matrix
+//           every element of src is in [0, COMPACT_SATURATED]
+// MODIFIES: *mat
+// EFFECTS:  Reshapes *mat to the size of src and copies src into it.
+void Compact_Matrix_narrow(Compact_Matrix* mat, const Matrix* src);
+
+// REQUIRES: mat points to a valid Compact_Matrix, dst points to a Matrix
+// MODIFIES: *dst
+// EFFECTS:  Reshapes *dst to the size of mat and copies mat into it.
+void Compact_Matrix_widen(const Compact_Matrix* mat, Matrix* dst);
+
+// REQUIRES: mat points to a valid Compact_Matrix
+// MODIFIES: *mat
+// EFFECTS:  Sets every element on the border of *mat to value.
+void Compact_Matrix_fill_border(Compact_Matrix* mat, uint16_t value);
+
+// REQUIRES: mat points to a valid Compact_Matrix with width >= 2
+//           seam.size() == mat->height
+//           0 <= seam[i] && seam[i] < mat->width for every i
+// MODIFIES: *mat
+// EFFECTS:  Removes element seam[i] from each row i, so the width of the
+//           matrix is one less than before.
+void Compact_Matrix_remove_vertical_seam(Compact_Matrix* mat,
+                                         const std::vector<int> &seam);
+
+// REQUIRES: energy points to a valid Compact_Matrix
+//           cost points to a Compact_Matrix, energy != cost
+// MODIFIES: *cost
+// EFFECTS:  Computes the cost matrix of energy the way
+//           compute_vertical_cost_matrix does, with every row stored
+//           relative to the minimum of the row above it. Returns false if
+//           any cell saturated, in which case the seam must be found with
+//           the 32-bit cost matrix instead. Uses 16-bit vector instructions
+//           when the selected energy kernel does.
+bool compute_compact_cost_matrix(const Compact_Matrix* energy,
+                                 Compact_Matrix* cost);
+
+// REQUIRES: cost was filled in by a successful compute_compact_cost_matrix
+//           seam points to a vector
+// MODIFIES: *seam
+// EFFECTS:  Same as find_minimal_vertical_seam on the 32-bit cost matrix
+//           of the same energies, including leftmost-wins ties.
+void find_minimal_compact_seam(const Compact_Matrix* cost,
+                               std::vector<int>* seam);
+
+#endif // COMPACT_HPP
@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "crop.hpp"
+#include "box_kernels.hpp"
+#include "energy_kernels.hpp"
+#include "Matrix.hpp"
+#include "processing.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+// REQUIRES: table points to an Energy_Table, img points to a valid Image
+// MODIFIES: *table
+// EFFECTS:  Builds the table for img in one pass over its pixels.
+void Energy_Table_init(Energy_Table* table, const Image* img) {
+  PROFILE_SCOPE(PROFILE_ENERGY, Image_bytes(img));
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  const size_t stride = static_cast<size_t>(width) + 1;
+  table->width = width;
+  table->height = height;
+  table->sums.assign(stride * (height + 1), 0);
+
+  // rows 0 and height - 1 and columns 0 and width - 1 are border pixels,
+  // which count as 0
+  vector<int> energy(width, 0);
+  for (int r = 0; r < height; r++) {
+    if (r > 0 && r < height - 1 && width > 2) {
+      const unsigned char* above[IMAGE_CHANNELS];
+      const unsigned char* here[IMAGE_CHANNELS];
+      const unsigned char* below[IMAGE_CHANNELS];
+      for (int ch = 0; ch < Image_channels(img); ch++) {
+        above[ch] = Image_row(img, ch, r - 1);
+        here[ch] = Image_row(img, ch, r);
+        below[ch] = Image_row(img, ch, r + 1);
+      }
+      energy_compute_row(above, here, below, Image_channels(img), 1,
+                         width - 2, energy.data());
+    } else {
+      fill(energy.begin(), energy.end(), 0);
+    }
+
+    const long long* prev = &table->sums[r * stride];
+    long long* out = &table->sums[(r + 1) * stride];
+    long long rowSum = 0;
+    for (int c = 0; c < width; c++) {
+      rowSum += energy[c];
+      out[c + 1] = prev[c + 1] + rowSum;
+    }
+  }
+}
+
+// REQUIRES: table points to an initialized Energy_Table
+//           0 <= top && top + height <= the table's height
+//           0 <= left && left + width <= the table's width
+// EFFECTS:  Returns the total energy of the height x width window whose
+//           top left pixel is (top, left).
+long long Energy_Table_sum(const Energy_Table* table, int top, int left,
+                           int width, int height) {
+  const size_t stride = static_cast<size_t>(table->width) + 1;
+  const long long* upper = &table->sums[top * stride];
+  const long long* lower = &table->sums[(top + height) * stride];
+  return lower[left + width] - lower[left] - upper[left + width] + upper[left];
+}
+
+// REQUIRES: table points to an initialized Energy_Table
+//           0 < width && width <= the table's width
+//           0 < height && height <= the table's height
+// MODIFIES: *top, *left
+// EFFECTS:  Finds the height x width window with the highest total energy
+//           and sets *top and *left to its top left pixel. Of equal
+//           windows, the one nearest the top, and then the left, is used.
+void Energy_Table_best_window(const Energy_Table* table, int width,
+                              int height, int* top, int* left) {
+  const size_t stride = static_cast<size_t>(table->width) + 1;
+  long long best = -1;
+  *top = 0;
+  *left = 0;
+
+  for (int r = 0; r + height <= table->height; r++) {
+    const long long* upper = &table->sums[r * stride];
+    const long long* lower = &table->sums[(r + height) * stride];
+    for (int c = 0; c + width <= table->width; c++) {
+      long long sum = lower[c + width] - lower[c] - upper[c + width] + upper[c];
+      if (sum > best) {
+        best = sum;
+        *top = r;
+        *left = c;
+      }
+    }
+  }
+}
+
+// REQUIRES: src points to a valid Image, dst points to an Image
+//           0 < width && 0 < height
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to the window of src with the highest total
+//           energy. The window is width x height, made smaller in either
+//           direction where src is smaller than that.
+void crop_max_energy_window(const Image* src, Image* dst, int width,
+                            int height) {
+  PROFILE_SCOPE(PROFILE_CROP, 0);
+  width = min(width, Image_width(src));
+  height = min(height, Image_height(src));
+
+  Energy_Table table;
+  Energy_Table_init(&table, src);
+  int top;
+  int left;
+  Energy_Table_best_window(&table, width, height, &top, &left);
+
+  Image_init(dst, width, height, Image_channels(src));
+  for (int ch = 0; ch < Image_channels(src); ch++) {
+    for (int r = 0; r < height; r++) {
+      memcpy(Image_row(dst, ch, r), Image_row(src, ch, top + r) + left, width);
+    }
+  }
+}
+
+// REQUIRES: 0 < srcWidth && 0 < srcHeight, channels is 1 or 3
+//           0 < width && 0 < height
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           that crop_max_energy_window holds at once to cut a width x
+//           height window out of a srcWidth x srcHeight source with the
+//           given channels, output included and the source not.
+long long crop_max_energy_window_memory(int srcWidth, int srcHeight,
+                                        int channels, int width, int height) {
+  const long long table = static_cast<long long>(sizeof(long long)) *
+                          (srcWidth + 1LL) * (srcHeight + 1LL);
+  return table + static_cast<long long>(min(width, srcWidth)) *
+                 min(height, srcHeight) * channels;
+}
+
+// REQUIRES: 0 < width && 0 < height
+//           0 <= row && row < height && 0 <= column && column < width
+// MODIFIES: *top, *left, *side
+// EFFECTS:  Places the square crop_square_centered_at_max_energy cuts out
+//           around pixel (row, column) of a width x height image: *side is
+//           CROP_SQUARE_SIDE, or less if the image is smaller, and the
+//           square is centered on the pixel, then moved as little as
+//           needed to fit inside the image.
+void crop_square_around(int width, int height, int row, int column,
+                        int* top, int* left, int* side) {
+  *side = min(CROP_SQUARE_SIDE, min(width, height));
+  int half = *side / 2;
+  *top = max(0, min(height - *side, row - half));
+  *left = max(0, min(width - *side, column - half));
+}
+
+// Sets dst to src shrunk by factor: every pixel is the rounded average
+// of a factor x factor block, and the blocks along the right and bottom
+// edges keep whatever pixels are left.
+static void box_downsample(const Image* src, Image* dst, int factor) {
+  const int width = Image_width(src);
+  const int height = Image_height(src);
+  const int proxyWidth = (width + factor - 1) / factor;
+  const int proxyHeight = (height + factor - 1) / factor;
+  Image_init(dst, proxyWidth, proxyHeight, Image_channels(src));
+
+  // the rows of a block are summed down each column first, by the box
+  // kernel, and then across the block's columns; a column of at most
+  // CROP_PROXY_MAX_FACTOR bytes fits in 16 bits
+  vector<uint16_t> columns(width);
+  for (int ch = 0; ch < Image_channels(src); ch++) {
+    for (int i = 0; i < proxyHeight; i++) {
+      const int top = i * factor;
+      const int bottom = min(height, top + factor);
+      fill(columns.begin(), columns.end(), 0);
+      for (int r = top; r < bottom; r++) {
+        box_accumulate_row(Image_row(src, ch, r), columns.data(), width);
+      }
+
+      unsigned char* out = Image_row(dst, ch, i);
+      for (int j = 0; j < proxyWidth; j++) {
+        const int left = j * factor;
+        const int right = min(width, left + factor);
+        int sum = 0;
+        for (int c = left; c < right; c++) {
+          sum += columns[c];
+        }
+        const int count = (bottom - top) * (right - left);
+        out[j] = static_cast<unsigned char>((sum + count / 2) / count);
+      }
+    }
+  }
+}
+
+// Sets *row and *column to the first interior cell of energy with the
+// largest value, or the first cell with it if there is no interior, as
+// crop_square_centered_at_max_energy picks its center.
+static void find_max_cell(const Matrix* energy, int* row, int* column) {
+  const int width = Matrix_width(energy);
+  const int height = Matrix_height(energy);
+  const int most = Matrix_max(energy);
+  // the border holds the interior maximum, so with an interior the cell
+  // is searched for inside it
+  const int inset = width >= 3 && height >= 3 ? 1 : 0;
+  for (int r = inset; r < height - inset; r++) {
+    for (int c = inset; c < width - inset; c++) {
+      if (*Matrix_at(energy, r, c) == most) {
+        *row = r;
+        *column = c;
+        return;
+      }
+    }
+  }
+}
+
+// REQUIRES: src points to a valid Image
+//           1 <= factor && factor <= CROP_PROXY_MAX_FACTOR
+// MODIFIES: *row, *column
+// EFFECTS:  Finds a pixel with nearly the most energy without computing
+//           the energies of the whole image. The image is shrunk by
+//           factor, each proxy pixel the average of a factor x factor
+//           block, and the proxy's most detailed pixel is found as
+//           crop_square_centered_at_max_energy finds it. The energies are
+//           then computed at full resolution only for the blocks within
+//           CROP_PROXY_MARGIN of that one, and *row and *column are set to
+//           the first of them with the most energy. With factor 1, or a
+//           proxy too small to have an interior, this is the pixel
+//           crop_square_centered_at_max_energy centers on.
+void find_max_energy_pixel_proxy(const Image* src, int factor, int* row,
+                                 int* column) {
+  const int width = Image_width(src);
+  const int height = Image_height(src);
+  Matrix energy;
+  if (factor <= 1 || (width + factor - 1) / factor < 3 ||
+      (height + factor - 1) / factor < 3) {
+    compute_energy_matrix(src, &energy);
+    find_max_cell(&energy, row, column);
+    return;
+  }
+
+  int proxyRow = 0;
+  int proxyColumn = 0;
+  {
+    Image proxy;
+    box_downsample(src, &proxy, factor);
+    compute_energy_matrix(&proxy, &energy);
+    find_max_cell(&energy, &proxyRow, &proxyColumn);
+  }
+
+  // the interior pixels of the blocks around the proxy's pick; the border
+  // pixels only ever get the interior maximum, so they never come first
+  const int top = max(1, (proxyRow - CROP_PROXY_MARGIN) * factor);
+  const int bottom = min(height - 2, (proxyRow + CROP_PROXY_MARGIN + 1) * factor - 1);
+  const int left = max(1, (proxyColumn - CROP_PROXY_MARGIN) * factor);
+  const int right = min(width - 2, (proxyColumn + CROP_PROXY_MARGIN + 1) * factor - 1);
+  PROFILE_SCOPE(PROFILE_ENERGY, static_cast<long long>(Image_channels(src)) *
+                                (bottom - top + 1) * (right - left + 1));
+
+  vector<int> values(width);
+  int most = -1;
+  for (int r = top; r <= bottom; r++) {
+    const unsigned char* above[IMAGE_CHANNELS];
+    const unsigned char* here[IMAGE_CHANNELS];
+    const unsigned char* below[IMAGE_CHANNELS];
+    for (int ch = 0; ch < Image_channels(src); ch++) {
+      above[ch] = Image_row(src, ch, r - 1);
+      here[ch] = Image_row(src, ch, r);
+      below[ch] = Image_row(src, ch, r + 1);
+    }
+    energy_compute_row(above, here, below, Image_channels(src), left, right,
+                       values.data());
+    for (int c = left; c <= right; c++) {
+      if (values[c] > most) {
+        most = values[c];
+        *row = r;
+        *column = c;
+      }
+    }
+  }
+}
+
+// REQUIRES: src points to a valid Image, dst points to an Image,
+//           1 <= factor && factor <= CROP_PROXY_MAX_FACTOR
+// MODIFIES: *dst
+// EFFECTS:  Like crop_square_centered_at_max_energy, but centered on the
+//           pixel find_max_energy_pixel_proxy finds. For factors of 4 or
+//           more this is several times faster on large images, and the
+//           crop usually lands on the same detail, if not the same pixel.
+void crop_square_centered_at_max_energy_proxy(const Image* src, Image* dst,
+                                              int factor) {
+  PROFILE_SCOPE(PROFILE_CROP, Image_bytes(src));
+  int row = 0;
+  int column = 0;
+  find_max_energy_pixel_proxy(src, factor, &row, &column);
+
+  int top;
+  int left;
+  int side;
+  crop_square_around(Image_width(src), Image_height(src), row, column,
+                     &top, &left, &side);
+  Image_init(dst, side, side, Image_channels(src));
+  for (int ch = 0; ch < Image_channels(src); ch++) {
+    for (int r = 0; r < side; r++) {
+      memcpy(Image_row(dst, ch, r), Image_row(src, ch, top + r) + left, side);
+    }
+  }
+}
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3, 1 <= factor
+// EFFECTS:  Returns the most tracked memory, in bytes, that
+//           crop_square_centered_at_max_energy_proxy holds at once for a
+//           width x height source with the given channels, output
+//           included and the source not.
+long long crop_square_centered_at_max_energy_proxy_memory(int width, int height,
+                                                          int channels, int factor) {
+  // the proxy image and its energies, or the energies of the source
+  const int proxyWidth = (width + factor - 1) / factor;
+  const int proxyHeight = (height + factor - 1) / factor;
+  const long long proxy = proxyWidth < 3 || proxyHeight < 3
+                        ? static_cast<long long>(width) * height
+                        : static_cast<long long>(proxyWidth) * proxyHeight;
+  const long long side = min(CROP_SQUARE_SIDE, min(width, height));
+  return (channels + sizeof(int)) * proxy + side * side * channels;
+}
+
+// Opens the named file for a pass over its rows and reads its header.
+// The file is read through a fixed-size buffer rather than mapped, so the
+// pages of the whole image are never resident at once.
+static bool open_pass(PPM_Reader* reader, std::ifstream& file,
+                      const std::string& filename, PPM_Header* header,
+                      std::string* error) {
+  file.open(filename, ios::binary);
+  if (!file) {
+    *error = "cannot open " + filename;
+    return false;
+  }
+  PPM_Reader_init(reader, file);
+  return PPM_read_header(reader, header, error);
+}
+
+// REQUIRES: dst points to an Image
+//           format is null or points to a PPM_Format
+// MODIFIES: *dst, *format, *error
+// EFFECTS:  Same as reading the named file and calling
+//           crop_square_centered_at_max_energy on it, but the image is
+//           never held in memory. A first pass reads it a row at a time and
+//           keeps three rows for the energies; a second pass skips to the
+//           square, seeking past binary rows where possible, and reads
+//           only its rows. Besides *dst, memory use is proportional to the
+//           image's width. The file's format is stored in *format if
+//           format is not null. Returns false and sets *error if the file
+//           cannot be read or is malformed.
+bool crop_square_centered_at_max_energy_file(const std::string& filename,
+                                             Image* dst, PPM_Format* format,
+                                             std::string* error) {
+  PROFILE_SCOPE(PROFILE_CROP, 0);
+  PPM_Header header;
+  int maxRow = 0;
+  int maxColumn = 0;
+
+  {
+    PROFILE_SCOPE(PROFILE_READ, 0);
+    PPM_Reader reader;
+    std::ifstream file;
+    if (!open_pass(&reader, file, filename, &header, error)) {
+      return false;
+    }
+    if (format) {
+      *format = header.format;
+    }
+    const int width = header.width;
+    const int height = header.height;
+    const int channels = header.format == PPM_P5 ? 1 : IMAGE_CHANNELS;
+
+    // rows i - 1, i and i + 1, kept in a ring of three rows per channel
+    vector<unsigned char> ring(static_cast<size_t>(3) * channels * width);
+    auto ringRow = [&](int i, int ch) {
+      return &ring[(static_cast<size_t>(i % 3) * channels + ch) * width];
+    };
+    vector<int> energy(width);
+
+    // the border pixels all get the interior maximum, and the first
+    // interior pixel with it is used; without an interior every energy
+    // is 0 and the first pixel is used
+    int maxEnergy = -1;
+    for (int i = 0; i < height; i++) {
+      bool read = channels == 1
+          ? PPM_read_gray_row(&reader, &header, ringRow(i, 0), error)
+          : PPM_read_row(&reader, &header, ringRow(i, 0), ringRow(i, 1),
+                         ringRow(i, 2), error);
+      if (!read) {
+        return false;
+      }
+      if (i < 2 || width < 3) {
+        continue;
+      }
+
+      const unsigned char* above[IMAGE_CHANNELS];
+      const unsigned char* here[IMAGE_CHANNELS];
+      const unsigned char* below[IMAGE_CHANNELS];
+      for (int ch = 0; ch < channels; ch++) {
+        above[ch] = ringRow(i - 2, ch);
+        here[ch] = ringRow(i - 1, ch);
+        below[ch] = ringRow(i, ch);
+      }
+      energy_compute_row(above, here, below, channels, 1, width - 2,
+                         energy.data());
+      for (int j = 1; j <= width - 2; j++) {
+        if (energy[j] > maxEnergy) {
+          maxEnergy = energy[j];
+          maxRow = i - 1;
+          maxColumn = j;
+        }
+      }
+    }
+    PROFILE_BYTES(static_cast<long long>(channels) * width * height);
+  }
+
+  int top;
+  int left;
+  int side;
+  crop_square_around(header.width, header.height, maxRow, maxColumn,
+                     &top, &left, &side);
+
+  // second pass: only the rows of the square are read
+  {
+    const int channels = header.format == PPM_P5 ? 1 : IMAGE_CHANNELS;
+    PROFILE_SCOPE(PROFILE_READ, static_cast<long long>(channels) * header.width * side);
+    PPM_Reader reader;
+    std::ifstream file;
+    if (!open_pass(&reader, file, filename, &header, error) ||
+        !PPM_skip_rows(&reader, &header, top, error)) {
+      return false;
+    }
+
+    Image_init(dst, side, side, channels);
+    vector<unsigned char> row(static_cast<size_t>(channels) * header.width);
+    unsigned char* planes[IMAGE_CHANNELS];
+    for (int ch = 0; ch < channels; ch++) {
+      planes[ch] = &row[static_cast<size_t>(ch) * header.width];
+    }
+    for (int r = 0; r < side; r++) {
+      bool read = channels == 1
+          ? PPM_read_gray_row(&reader, &header, planes[0], error)
+          : PPM_read_row(&reader, &header, planes[0], planes[1], planes[2],
+                         error);
+      if (!read) {
+        return false;
+      }
+      for (int ch = 0; ch < channels; ch++) {
+        memcpy(Image_row(dst, ch, r), planes[ch] + left, side);
+      }
+    }
+  }
+  return true;
+}
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory, in bytes, that
+//           crop_square_centered_at_max_energy_file holds at once for a
+//           width x height file with the given channels: only the output.
+long long crop_square_centered_at_max_energy_file_memory(int width, int height,
+                                                         int channels) {
+  const long long side = min(CROP_SQUARE_SIDE, min(width, height));
+  return side * side * channels;
+}
@@ -0,0 +1,149 @@
+#ifndef CROP_HPP
+#define CROP_HPP
+
+/* crop.hpp
+ * Cropping to the window with the most detail. The energies of an image
+ * are summed into a table once; after that the total energy of any
+ * rectangle takes four lookups, so windows of any size and aspect ratio
+ * can be searched without computing the energies again. Also the square
+ * crop around the most detailed pixel, including a version that streams
+ * the file instead of loading it and one that searches a shrunk copy of
+ * the image first.
+ */
+
+#include <string>
+#include <vector>
+#include "Image.hpp"
+#include "memory.hpp"
+#include "ppm.hpp"
+
+// Side of the square crop_square_centered_at_max_energy aims for.
+const int CROP_SQUARE_SIDE = 512;
+
+// Largest factor crop_square_centered_at_max_energy_proxy shrinks by.
+const int CROP_PROXY_MAX_FACTOR = 256;
+
+// How many proxy pixels around the proxy's most detailed one are searched
+// again at full resolution by find_max_energy_pixel_proxy.
+const int CROP_PROXY_MARGIN = 1;
+
+// Summed-area table of the energies of an image.
+// sums[(r * (width + 1)) + c] is the total energy of the pixels above row
+// r and left of column c. Pixels on the border of the image count as 0,
+// since compute_energy_matrix gives them an artificial value.
+struct Energy_Table {
+  int width;
+  int height;
+  Tracked_Vector<long long> sums;
+};
+
+// REQUIRES: table points to an Energy_Table, img points to a valid Image
+// MODIFIES: *table
+// EFFECTS:  Builds the table for img in one pass over its pixels.
+void Energy_Table_init(Energy_Table* table, const Image* img);
+
+// REQUIRES: table points to an initialized Energy_Table
+//           0 <= top && top + height <= the table's height
+//           0 <= left && left + width <= the table's width
+// EFFECTS:  Returns the total energy of the height x width window whose
+//           top left pixel is (top, left).
+long long Energy_Table_sum(const Energy_Table* table, int top, int left,
+                           int width, int height);
+
+// REQUIRES: table points to an initialized Energy_Table
+//           0 < width && width <= the table's width
+//           0 < height && height <= the table's height
+// MODIFIES: *top, *left
+// EFFECTS:  Finds the height x width window with the highest total energy
+//           and sets *top and *left to its top left pixel. Of equal
+//           windows, the one nearest the top, and then the left, is used.
+void Energy_Table_best_window(const Energy_Table* table, int width,
+                              int height, int* top, int* left);
+
+// REQUIRES: src points to a valid Image, dst points to an Image
+//           0 < width && 0 < height
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to the window of src with the highest total
+//           energy. The window is width x height, made smaller in either
+//           direction where src is smaller than that.
+void crop_max_energy_window(const Image* src, Image* dst, int width,
+                            int height);
+
+// REQUIRES: 0 < srcWidth && 0 < srcHeight, channels is 1 or 3
+//           0 < width && 0 < height
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           that crop_max_energy_window holds at once to cut a width x
+//           height window out of a srcWidth x srcHeight source with the
+//           given channels, output included and the source not.
+long long crop_max_energy_window_memory(int srcWidth, int srcHeight,
+                                        int channels, int width, int height);
+
+// REQUIRES: 0 < width && 0 < height
+//           0 <= row && row < height && 0 <= column && column < width
+// MODIFIES: *top, *left, *side
+// EFFECTS:  Places the square crop_square_centered_at_max_energy cuts out
+//           around pixel (row, column) of a width x height image: *side is
+//           CROP_SQUARE_SIDE, or less if the image is smaller, and the
+//           square is centered on the pixel, then moved as little as
+//           needed to fit inside the image.
+void crop_square_around(int width, int height, int row, int column,
+                        int* top, int* left, int* side);
+
+// REQUIRES: src points to a valid Image
+//           1 <= factor && factor <= CROP_PROXY_MAX_FACTOR
+// MODIFIES: *row, *column
+// EFFECTS:  Finds a pixel with nearly the most energy without computing
+//           the energies of the whole image. The image is shrunk by
+//           factor, each proxy pixel the average of a factor x factor
+//           block, and the proxy's most detailed pixel is found as
+//           crop_square_centered_at_max_energy finds it. The energies are
+//           then computed at full resolution only for the blocks within
+//           CROP_PROXY_MARGIN of that one, and *row and *column are set to
+//           the first of them with the most energy. With factor 1, or a
+//           proxy too small to have an interior, this is the pixel
+//           crop_square_centered_at_max_energy centers on.
+void find_max_energy_pixel_proxy(const Image* src, int factor, int* row,
+                                 int* column);
+
+// REQUIRES: src points to a valid Image, dst points to an Image,
+//           1 <= factor && factor <= CROP_PROXY_MAX_FACTOR
+// MODIFIES: *dst
+// EFFECTS:  Like crop_square_centered_at_max_energy, but centered on the
+//           pixel find_max_energy_pixel_proxy finds. For factors of 4 or
+//           more this is several times faster on large images, and the
+//           crop usually lands on the same detail, if not the same pixel.
+void crop_square_centered_at_max_energy_proxy(const Image* src, Image* dst,
+                                              int factor);
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3, 1 <= factor
+// EFFECTS:  Returns the most tracked memory, in bytes, that
+//           crop_square_centered_at_max_energy_proxy holds at once for a
+//           width x height source with the given channels, output
+//           included and the source not.
+long long crop_square_centered_at_max_energy_proxy_memory(int width, int height,
+                                                          int channels, int factor);
+
+// REQUIRES: dst points to an Image
+//           format is null or points to a PPM_Format
+// MODIFIES: *dst, *format, *error
+// EFFECTS:  Same as reading the named file and calling
+//           crop_square_centered_at_max_energy on it, but the image is
+//           never held in memory. A first pass reads it a row at a time and
+//           keeps three rows for the energies; a second pass skips to the
+//           square, seeking past binary rows where possible, and reads
+//           only its rows. Besides *dst, memory use is proportional to the
+//           image's width. The file's format is stored in *format if
+//           format is not null. Returns false and sets *error if the file
+//           cannot be read or is malformed.
+bool crop_square_centered_at_max_energy_file(const std::string& filename,
+                                             Image* dst, PPM_Format* format,
+                                             std::string* error);
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory, in bytes, that
+//           crop_square_centered_at_max_energy_file holds at once for a
+//           width x height file with the given channels: only the output.
+long long crop_square_centered_at_max_energy_file_memory(int width, int height,
+                                                         int channels);
+
+#endif // CROP_HPP
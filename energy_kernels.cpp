@@ -0,0 +1,389 @@
+#include <cstring>
+#include "energy_kernels.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ENERGY_HAVE_X86 1
+#endif
+
+// Each kernel works on the channel rows above, on and below the pixel,
+// and comes in a version for color images and one for gray images, so a
+// gray image reads and differences one row per neighbour instead of
+// three. The color vector kernels widen 8-bit values to 32-bit lanes,
+// square the differences with a multiply-add (|d| fits in the low 16 bits
+// and the high 16 bits are zero, so pmaddwd gives exactly d*d), and
+// divide by 100 in single precision. Every numerator is at most
+// 3 * 255 * 255, far below 2^24, and the correctly rounded quotient never
+// reaches the next integer, so truncating it gives exactly the integer
+// division.
+//
+// The gray vector kernels work in 16-bit lanes, twice as many per
+// vector. d*d fits in 16 unsigned bits, and (3 * d * d) / 100 is exactly
+// the high half of d*d times GRAY_RECIPROCAL, shifted right by
+// GRAY_SHIFT (checked for every d from 0 to 255). The sum of the two
+// directions is at most ENERGY_MAX, which fits as well.
+
+static const int GRAY_RECIPROCAL = 15729;
+static const int GRAY_SHIFT = 3;
+
+typedef void (*Row_Kernel)(const unsigned char* const* above,
+                           const unsigned char* const* row,
+                           const unsigned char* const* below,
+                           int lo, int hi, int* out);
+
+template <int Channels>
+static void energy_row_scalar(const unsigned char* const* above,
+                              const unsigned char* const* row,
+                              const unsigned char* const* below,
+                              int lo, int hi, int* out) {
+  for (int j = lo; j <= hi; j++) {
+    int vertical = 0;
+    int horizontal = 0;
+    for (int ch = 0; ch < Channels; ch++) {
+      int dv = below[ch][j] - above[ch][j];
+      int dh = row[ch][j + 1] - row[ch][j - 1];
+      vertical += dv * dv;
+      horizontal += dh * dh;
+    }
+    if (Channels == 1) {
+      vertical *= ENERGY_GRAY_WEIGHT;
+      horizontal *= ENERGY_GRAY_WEIGHT;
+    }
+    // Divide by 100 is to avoid possible overflows
+    // later on in the algorithm.
+    out[j] = vertical / 100 + horizontal / 100;
+  }
+}
+
+#ifdef ENERGY_HAVE_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i squared_diff_sse41(const unsigned char* a,
+                                         const unsigned char* b) {
+  int a4;
+  int b4;
+  std::memcpy(&a4, a, 4);
+  std::memcpy(&b4, b, 4);
+  __m128i va = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(a4));
+  __m128i vb = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(b4));
+  __m128i d = _mm_abs_epi32(_mm_sub_epi32(va, vb));
+  return _mm_madd_epi16(d, d);
+}
+
+__attribute__((target("sse4.1")))
+static void energy_row_sse41(const unsigned char* const* above,
+                             const unsigned char* const* row,
+                             const unsigned char* const* below,
+                             int lo, int hi, int* out) {
+  const __m128 hundred = _mm_set1_ps(100.0f);
+  int j = lo;
+
+  for (; j + 3 <= hi; j += 4) {
+    __m128i vertical = _mm_setzero_si128();
+    __m128i horizontal = _mm_setzero_si128();
+    for (int ch = 0; ch < 3; ch++) {
+      vertical = _mm_add_epi32(vertical,
+                               squared_diff_sse41(below[ch] + j, above[ch] + j));
+      horizontal = _mm_add_epi32(horizontal,
+                                 squared_diff_sse41(row[ch] + j + 1, row[ch] + j - 1));
+    }
+    __m128i v = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(vertical), hundred));
+    __m128i h = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(horizontal), hundred));
+    _mm_storeu_si128((__m128i*)(out + j), _mm_add_epi32(v, h));
+  }
+
+  energy_row_scalar<3>(above, row, below, j, hi, out);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i gray_part_sse41(const unsigned char* a,
+                                      const unsigned char* b) {
+  __m128i va = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)a));
+  __m128i vb = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)b));
+  __m128i d = _mm_abs_epi16(_mm_sub_epi16(va, vb));
+  __m128i square = _mm_mullo_epi16(d, d);
+  return _mm_srli_epi16(
+      _mm_mulhi_epu16(square, _mm_set1_epi16(GRAY_RECIPROCAL)), GRAY_SHIFT);
+}
+
+__attribute__((target("sse4.1")))
+static void gray_row_sse41(const unsigned char* const* above,
+                           const unsigned char* const* row,
+                           const unsigned char* const* below,
+                           int lo, int hi, int* out) {
+  const unsigned char* up = above[0];
+  const unsigned char* here = row[0];
+  const unsigned char* down = below[0];
+  int j = lo;
+
+  for (; j + 7 <= hi; j += 8) {
+    __m128i energy = _mm_add_epi16(gray_part_sse41(down + j, up + j),
+                                   gray_part_sse41(here + j + 1, here + j - 1));
+    _mm_storeu_si128((__m128i*)(out + j), _mm_cvtepu16_epi32(energy));
+    _mm_storeu_si128((__m128i*)(out + j + 4),
+                     _mm_cvtepu16_epi32(_mm_srli_si128(energy, 8)));
+  }
+
+  energy_row_scalar<1>(above, row, below, j, hi, out);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i squared_diff_avx2(const unsigned char* a,
+                                        const unsigned char* b) {
+  __m256i va = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)a));
+  __m256i vb = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)b));
+  __m256i d = _mm256_abs_epi32(_mm256_sub_epi32(va, vb));
+  return _mm256_madd_epi16(d, d);
+}
+
+__attribute__((target("avx2")))
+static void energy_row_avx2(const unsigned char* const* above,
+                            const unsigned char* const* row,
+                            const unsigned char* const* below,
+                            int lo, int hi, int* out) {
+  const __m256 hundred = _mm256_set1_ps(100.0f);
+  int j = lo;
+
+  for (; j + 7 <= hi; j += 8) {
+    __m256i vertical = _mm256_setzero_si256();
+    __m256i horizontal = _mm256_setzero_si256();
+    for (int ch = 0; ch < 3; ch++) {
+      vertical = _mm256_add_epi32(vertical,
+                                  squared_diff_avx2(below[ch] + j, above[ch] + j));
+      horizontal = _mm256_add_epi32(horizontal,
+                                    squared_diff_avx2(row[ch] + j + 1, row[ch] + j - 1));
+    }
+    __m256i v = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(vertical), hundred));
+    __m256i h = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(horizontal), hundred));
+    _mm256_storeu_si256((__m256i*)(out + j), _mm256_add_epi32(v, h));
+  }
+
+  energy_row_scalar<3>(above, row, below, j, hi, out);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gray_part_avx2(const unsigned char* a,
+                                     const unsigned char* b) {
+  __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)a));
+  __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)b));
+  __m256i d = _mm256_abs_epi16(_mm256_sub_epi16(va, vb));
+  __m256i square = _mm256_mullo_epi16(d, d);
+  return _mm256_srli_epi16(
+      _mm256_mulhi_epu16(square, _mm256_set1_epi16(GRAY_RECIPROCAL)), GRAY_SHIFT);
+}
+
+__attribute__((target("avx2")))
+static void gray_row_avx2(const unsigned char* const* above,
+                          const unsigned char* const* row,
+                          const unsigned char* const* below,
+                          int lo, int hi, int* out) {
+  const unsigned char* up = above[0];
+  const unsigned char* here = row[0];
+  const unsigned char* down = below[0];
+  int j = lo;
+
+  for (; j + 15 <= hi; j += 16) {
+    __m256i energy = _mm256_add_epi16(gray_part_avx2(down + j, up + j),
+                                      gray_part_avx2(here + j + 1, here + j - 1));
+    _mm256_storeu_si256((__m256i*)(out + j),
+                        _mm256_cvtepu16_epi32(_mm256_castsi256_si128(energy)));
+    _mm256_storeu_si256((__m256i*)(out + j + 8),
+                        _mm256_cvtepu16_epi32(_mm256_extracti128_si256(energy, 1)));
+  }
+
+  energy_row_scalar<1>(above, row, below, j, hi, out);
+}
+
+// GCC 12 warns about the deliberately undefined pass-through operand
+// inside its own AVX-512 intrinsics when they are used from a function
+// with a target attribute.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i squared_diff_avx512(const unsigned char* a,
+                                          const unsigned char* b) {
+  __m512i va = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)a));
+  __m512i vb = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)b));
+  __m512i d = _mm512_abs_epi32(_mm512_sub_epi32(va, vb));
+  return _mm512_madd_epi16(d, d);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void energy_row_avx512(const unsigned char* const* above,
+                              const unsigned char* const* row,
+                              const unsigned char* const* below,
+                              int lo, int hi, int* out) {
+  const __m512 hundred = _mm512_set1_ps(100.0f);
+  int j = lo;
+
+  for (; j + 15 <= hi; j += 16) {
+    __m512i vertical = _mm512_setzero_si512();
+    __m512i horizontal = _mm512_setzero_si512();
+    for (int ch = 0; ch < 3; ch++) {
+      vertical = _mm512_add_epi32(vertical,
+                                  squared_diff_avx512(below[ch] + j, above[ch] + j));
+      horizontal = _mm512_add_epi32(horizontal,
+                                    squared_diff_avx512(row[ch] + j + 1, row[ch] + j - 1));
+    }
+    __m512i v = _mm512_cvttps_epi32(_mm512_div_ps(_mm512_cvtepi32_ps(vertical), hundred));
+    __m512i h = _mm512_cvttps_epi32(_mm512_div_ps(_mm512_cvtepi32_ps(horizontal), hundred));
+    _mm512_storeu_si512(out + j, _mm512_add_epi32(v, h));
+  }
+
+  energy_row_avx2(above, row, below, j, hi, out);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i gray_part_avx512(const unsigned char* a,
+                                       const unsigned char* b) {
+  __m512i va = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)a));
+  __m512i vb = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)b));
+  __m512i d = _mm512_abs_epi16(_mm512_sub_epi16(va, vb));
+  __m512i square = _mm512_mullo_epi16(d, d);
+  return _mm512_srli_epi16(
+      _mm512_mulhi_epu16(square, _mm512_set1_epi16(GRAY_RECIPROCAL)), GRAY_SHIFT);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gray_row_avx512(const unsigned char* const* above,
+                            const unsigned char* const* row,
+                            const unsigned char* const* below,
+                            int lo, int hi, int* out) {
+  const unsigned char* up = above[0];
+  const unsigned char* here = row[0];
+  const unsigned char* down = below[0];
+  int j = lo;
+
+  for (; j + 31 <= hi; j += 32) {
+    __m512i energy = _mm512_add_epi16(gray_part_avx512(down + j, up + j),
+                                      gray_part_avx512(here + j + 1, here + j - 1));
+    _mm512_storeu_si512(out + j,
+                        _mm512_cvtepu16_epi32(_mm512_castsi512_si256(energy)));
+    _mm512_storeu_si512(out + j + 16,
+                        _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(energy, 1)));
+  }
+
+  gray_row_avx2(above, row, below, j, hi, out);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // ENERGY_HAVE_X86
+
+static Row_Kernel kernel_function(Energy_Kernel kernel, bool gray) {
+  switch (kernel) {
+#ifdef ENERGY_HAVE_X86
+  case ENERGY_KERNEL_SSE41:
+    return gray ? gray_row_sse41 : energy_row_sse41;
+  case ENERGY_KERNEL_AVX2:
+    return gray ? gray_row_avx2 : energy_row_avx2;
+  case ENERGY_KERNEL_AVX512:
+    return gray ? gray_row_avx512 : energy_row_avx512;
+#endif
+  default:
+    return gray ? energy_row_scalar<1> : energy_row_scalar<3>;
+  }
+}
+
+// EFFECTS:  Returns true if kernel can run on this CPU.
+bool energy_kernel_supported(Energy_Kernel kernel) {
+  switch (kernel) {
+  case ENERGY_KERNEL_SCALAR:
+    return true;
+#ifdef ENERGY_HAVE_X86
+  case ENERGY_KERNEL_SSE41:
+    return __builtin_cpu_supports("sse4.1");
+  case ENERGY_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case ENERGY_KERNEL_AVX512:
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+#endif
+  default:
+    return false;
+  }
+}
+
+// EFFECTS:  Returns the fastest kernel that can run on this CPU. This is
+//           the kernel used until energy_kernel_select is called.
+Energy_Kernel energy_kernel_best() {
+  static const Energy_Kernel order[] = {
+    ENERGY_KERNEL_AVX512, ENERGY_KERNEL_AVX2, ENERGY_KERNEL_SSE41
+  };
+  for (Energy_Kernel kernel : order) {
+    if (energy_kernel_supported(kernel)) {
+      return kernel;
+    }
+  }
+  return ENERGY_KERNEL_SCALAR;
+}
+
+// The selected kernel, chosen on first use.
+static Energy_Kernel& selected_kernel() {
+  static Energy_Kernel kernel = energy_kernel_best();
+  return kernel;
+}
+
+// The selected kernel's row functions for gray images (0) and color
+// images (1).
+static Row_Kernel* selected_functions() {
+  static Row_Kernel functions[2] = {
+    kernel_function(selected_kernel(), true),
+    kernel_function(selected_kernel(), false)
+  };
+  return functions;
+}
+
+// REQUIRES: channels is 1 (gray) or 3 (red, green, blue)
+//           above, row and below each hold channels pointers, one per
+//           channel, to rows i - 1, i and i + 1 of an image
+//           1 <= lo, and hi + 1 is a valid column of those rows
+// MODIFIES: out[lo..hi]
+// EFFECTS:  For each column j in [lo, hi], sets out[j] to the energy of
+//           pixel (i, j): the squared difference between the pixels above
+//           and below divided by 100, plus the squared difference between
+//           the pixels to the left and right divided by 100. Gray
+//           differences count ENERGY_GRAY_WEIGHT times. Uses the selected
+//           kernel, specialised for the channel count.
+void energy_compute_row(const unsigned char* const* above,
+                        const unsigned char* const* row,
+                        const unsigned char* const* below,
+                        int channels, int lo, int hi, int* out) {
+  selected_functions()[channels == 1 ? 0 : 1](above, row, below, lo, hi, out);
+}
+
+// REQUIRES: kernel is supported on this CPU
+// MODIFIES: the kernel used by energy_compute_row
+// EFFECTS:  Makes energy_compute_row use the given kernel. Meant for
+//           benchmarks and testing; not safe to call while other threads
+//           are computing energies.
+void energy_kernel_select(Energy_Kernel kernel) {
+  selected_kernel() = kernel;
+  selected_functions()[0] = kernel_function(kernel, true);
+  selected_functions()[1] = kernel_function(kernel, false);
+}
+
+// EFFECTS:  Returns the kernel energy_compute_row currently uses.
+Energy_Kernel energy_kernel_current() {
+  return selected_kernel();
+}
+
+// EFFECTS:  Returns a short name for the kernel, such as "avx2".
+const char* energy_kernel_name(Energy_Kernel kernel) {
+  switch (kernel) {
+  case ENERGY_KERNEL_SSE41:
+    return "sse4.1";
+  case ENERGY_KERNEL_AVX2:
+    return "avx2";
+  case ENERGY_KERNEL_AVX512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
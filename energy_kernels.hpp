@@ -0,0 +1,64 @@
+#ifndef ENERGY_KERNELS_HPP
+#define ENERGY_KERNELS_HPP
+
+/* energy_kernels.hpp
+ * Row kernels for the energy computation used by compute_energy_matrix.
+ * Vectorized versions are picked at runtime based on what the CPU
+ * supports; every kernel gives exactly the same results as the scalar
+ * one.
+ */
+
+// Available implementations of the energy row kernel.
+enum Energy_Kernel {
+  ENERGY_KERNEL_SCALAR,
+  ENERGY_KERNEL_SSE41,
+  ENERGY_KERNEL_AVX2,
+  ENERGY_KERNEL_AVX512
+};
+
+// Largest energy a pixel can have: 3 * 255 * 255 / 100 in each direction,
+// for gray and color images alike.
+const int ENERGY_MAX = 2 * (3 * 255 * 255 / 100);
+
+// Times the difference between two gray values counts in an energy: a
+// gray image has the energies it would have stored with three equal
+// channels.
+const int ENERGY_GRAY_WEIGHT = 3;
+
+// REQUIRES: channels is 1 (gray) or 3 (red, green, blue)
+//           above, row and below each hold channels pointers, one per
+//           channel, to rows i - 1, i and i + 1 of an image
+//           1 <= lo, and hi + 1 is a valid column of those rows
+// MODIFIES: out[lo..hi]
+// EFFECTS:  For each column j in [lo, hi], sets out[j] to the energy of
+//           pixel (i, j): the squared difference between the pixels above
+//           and below divided by 100, plus the squared difference between
+//           the pixels to the left and right divided by 100. Gray
+//           differences count ENERGY_GRAY_WEIGHT times. Uses the selected
+//           kernel, specialised for the channel count.
+void energy_compute_row(const unsigned char* const* above,
+                        const unsigned char* const* row,
+                        const unsigned char* const* below,
+                        int channels, int lo, int hi, int* out);
+
+// EFFECTS:  Returns true if kernel can run on this CPU.
+bool energy_kernel_supported(Energy_Kernel kernel);
+
+// EFFECTS:  Returns the fastest kernel that can run on this CPU. This is
+//           the kernel used until energy_kernel_select is called.
+Energy_Kernel energy_kernel_best();
+
+// REQUIRES: kernel is supported on this CPU
+// MODIFIES: the kernel used by energy_compute_row
+// EFFECTS:  Makes energy_compute_row use the given kernel. Meant for
+//           benchmarks and testing; not safe to call while other threads
+//           are computing energies.
+void energy_kernel_select(Energy_Kernel kernel);
+
+// EFFECTS:  Returns the kernel energy_compute_row currently uses.
+Energy_Kernel energy_kernel_current();
+
+// EFFECTS:  Returns a short name for the kernel, such as "avx2".
+const char* energy_kernel_name(Energy_Kernel kernel);
+
+#endif // ENERGY_KERNELS_HPP
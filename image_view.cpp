@@ -0,0 +1,72 @@
+#include "image_view.hpp"
+
+// REQUIRES: view points to an Image_View, img points to a valid Image
+// MODIFIES: *view
+// EFFECTS:  Makes *view an upright view of img.
+void Image_View_init(Image_View* view, Image* img) {
+  view->img = img;
+  view->turns = 0;
+}
+
+// REQUIRES: view points to a valid Image_View
+// MODIFIES: *view
+// EFFECTS:  Turns the view 90 degrees to the left (counterclockwise).
+//           The image is not touched.
+void Image_View_rotate_left(Image_View* view) {
+  view->turns = (view->turns + 1) % 4;
+}
+
+// REQUIRES: view points to a valid Image_View
+// MODIFIES: *view
+// EFFECTS:  Turns the view 90 degrees to the right (clockwise). The image
+//           is not touched.
+void Image_View_rotate_right(Image_View* view) {
+  view->turns = (view->turns + 3) % 4;
+}
+
+// REQUIRES: view points to a valid Image_View
+// EFFECTS:  Returns the width of the view: the image's height if the view
+//           is turned sideways, its width otherwise.
+int Image_View_width(const Image_View* view) {
+  return view->turns % 2 ? Image_height(view->img) : Image_width(view->img);
+}
+
+// REQUIRES: view points to a valid Image_View
+// EFFECTS:  Returns the height of the view.
+int Image_View_height(const Image_View* view) {
+  return view->turns % 2 ? Image_width(view->img) : Image_height(view->img);
+}
+
+// REQUIRES: view points to a valid Image_View
+//           0 <= row && row < Image_View_height(view)
+// MODIFIES: *offset, *step
+// EFFECTS:  Describes row of the view as a run through each channel plane
+//           of the image: column j of the row is the byte at
+//           *offset + j * *step from Image_row(view->img, ch, 0). *step is
+//           1 or -1 for rows of the image and the image's stride, or its
+//           negative, for columns.
+void Image_View_run(const Image_View* view, int row, long* offset, long* step) {
+  const Image* img = view->img;
+  const long stride = img->stride;
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+
+  switch (view->turns) {
+  case 0:
+    *offset = row * stride;
+    *step = 1;
+    break;
+  case 1:
+    *offset = width - 1 - row;
+    *step = stride;
+    break;
+  case 2:
+    *offset = (height - 1 - row) * stride + width - 1;
+    *step = -1;
+    break;
+  default:
+    *offset = (height - 1) * stride + row;
+    *step = -stride;
+    break;
+  }
+}
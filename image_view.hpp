@@ -0,0 +1,63 @@
+#ifndef IMAGE_VIEW_HPP
+#define IMAGE_VIEW_HPP
+
+/* image_view.hpp
+ * A rotated view of an Image. Rotating a view only changes how its rows
+ * and columns map onto the image, so it takes O(1) time and moves no
+ * pixels; the processing functions that take a view read and modify the
+ * image through that mapping. materialize_view (processing.hpp) copies
+ * the view out into an upright Image when one is really needed.
+ */
+
+#include "Image.hpp"
+
+// A view of *img turned by turns quarter turns to the left (counter-
+// clockwise), 0 to 3. Pixel (row, column) of the view is
+//   turns 0: pixel (row, column) of the image
+//   turns 1: pixel (column, width - 1 - row), as after rotate_left
+//   turns 2: pixel (height - 1 - row, width - 1 - column)
+//   turns 3: pixel (height - 1 - column, row), as after rotate_right
+// where width and height are those of the image. The view sees changes
+// to the image, including its size.
+struct Image_View {
+  Image* img;
+  int turns;
+};
+
+// REQUIRES: view points to an Image_View, img points to a valid Image
+// MODIFIES: *view
+// EFFECTS:  Makes *view an upright view of img.
+void Image_View_init(Image_View* view, Image* img);
+
+// REQUIRES: view points to a valid Image_View
+// MODIFIES: *view
+// EFFECTS:  Turns the view 90 degrees to the left (counterclockwise).
+//           The image is not touched.
+void Image_View_rotate_left(Image_View* view);
+
+// REQUIRES: view points to a valid Image_View
+// MODIFIES: *view
+// EFFECTS:  Turns the view 90 degrees to the right (clockwise). The image
+//           is not touched.
+void Image_View_rotate_right(Image_View* view);
+
+// REQUIRES: view points to a valid Image_View
+// EFFECTS:  Returns the width of the view: the image's height if the view
+//           is turned sideways, its width otherwise.
+int Image_View_width(const Image_View* view);
+
+// REQUIRES: view points to a valid Image_View
+// EFFECTS:  Returns the height of the view.
+int Image_View_height(const Image_View* view);
+
+// REQUIRES: view points to a valid Image_View
+//           0 <= row && row < Image_View_height(view)
+// MODIFIES: *offset, *step
+// EFFECTS:  Describes row of the view as a run through each channel plane
+//           of the image: column j of the row is the byte at
+//           *offset + j * *step from Image_row(view->img, ch, 0). *step is
+//           1 or -1 for rows of the image and the image's stride, or its
+//           negative, for columns.
+void Image_View_run(const Image_View* view, int row, long* offset, long* step);
+
+#endif // IMAGE_VIEW_HPP
@@ -0,0 +1,97 @@
+#include <atomic>
+#include <new>
+#include "memory.hpp"
+#include "profile.hpp"
+
+// The default allocator: operator new and delete, so that tracked
+// buffers still show up wherever those are replaced or counted.
+static void* new_allocate(size_t size, void*) {
+  return ::operator new(size, std::nothrow);
+}
+
+static void new_release(void* pointer, size_t, void*) {
+  ::operator delete(pointer);
+}
+
+static const Memory_Allocator NEW_ALLOCATOR = { new_allocate, new_release, nullptr };
+
+static const Memory_Allocator* allocator = &NEW_ALLOCATOR;
+static std::atomic<long long> limit(0);
+static std::atomic<long long> current(0);
+static std::atomic<long long> peak(0);
+
+// REQUIRES: allocator is null or points to a Memory_Allocator that
+//           outlives its use; no tracked buffer is allocated
+// MODIFIES: the memory state
+// EFFECTS:  Makes tracked buffers come from allocator, or from operator
+//           new and delete if allocator is null.
+void memory_set_allocator(const Memory_Allocator* allocator_in) {
+  allocator = allocator_in ? allocator_in : &NEW_ALLOCATOR;
+}
+
+// MODIFIES: the memory state
+// EFFECTS:  Sets the most bytes tracked buffers may hold at once, or
+//           removes the limit if limit is 0.
+void memory_set_limit(long long limit_in) {
+  limit = limit_in;
+}
+
+// EFFECTS:  Returns the limit set by memory_set_limit (0 for none).
+long long memory_limit() {
+  return limit;
+}
+
+// EFFECTS:  Returns the bytes tracked buffers hold now.
+long long memory_current() {
+  return current;
+}
+
+// EFFECTS:  Returns the most bytes tracked buffers have held at once
+//           since the start or the last memory_reset_peak.
+long long memory_peak() {
+  return peak;
+}
+
+// MODIFIES: the memory state
+// EFFECTS:  Restarts the peak from the bytes held now.
+void memory_reset_peak() {
+  peak = current.load();
+}
+
+// MODIFIES: the memory state
+// EFFECTS:  Returns a tracked buffer of size bytes. Throws std::bad_alloc
+//           if it would take the bytes held past the limit or the
+//           allocator has no memory. Safe to call from several threads.
+void* memory_allocate(size_t size) {
+  const long long bytes = static_cast<long long>(size);
+  const long long total = current.fetch_add(bytes) + bytes;
+  const long long most = limit.load(std::memory_order_relaxed);
+  if (most > 0 && total > most) {
+    current.fetch_sub(bytes);
+    throw std::bad_alloc();
+  }
+
+  void* pointer = size == 0 ? nullptr : allocator->allocate(size, allocator->context);
+  if (!pointer && size > 0) {
+    current.fetch_sub(bytes);
+    throw std::bad_alloc();
+  }
+
+  long long seen = peak.load(std::memory_order_relaxed);
+  while (total > seen && !peak.compare_exchange_weak(seen, total)) {
+  }
+  if (profile_on) {
+    profile_note_memory(total);
+  }
+  return pointer;
+}
+
+// REQUIRES: pointer came from memory_allocate(size)
+// MODIFIES: the memory state
+// EFFECTS:  Gives the buffer back. Safe to call from several threads.
+void memory_release(void* pointer, size_t size) {
+  if (pointer) {
+    allocator->release(pointer, size, allocator->context);
+  }
+  current.fetch_sub(static_cast<long long>(size));
+}
@@ -0,0 +1,97 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+/* memory.hpp
+ * Accounting of the memory held by images, matrices and seam steps,
+ * which is nearly all the memory resizing uses. Their buffers come from
+ * a replaceable allocator through Tracked_Vector, and the bytes they
+ * hold are counted, so the current and peak use are known and a limit
+ * can be enforced at the allocation that would break it.
+ */
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Where tracked buffers come from. allocate returns size bytes suitably
+// aligned for any type, or null if it has none; release gives back a
+// buffer from allocate with the size it was allocated with. context is
+// passed to both.
+struct Memory_Allocator {
+  void* (*allocate)(size_t size, void* context);
+  void (*release)(void* pointer, size_t size, void* context);
+  void* context;
+};
+
+// REQUIRES: allocator is null or points to a Memory_Allocator that
+//           outlives its use; no tracked buffer is allocated
+// MODIFIES: the memory state
+// EFFECTS:  Makes tracked buffers come from allocator, or from operator
+//           new and delete if allocator is null.
+void memory_set_allocator(const Memory_Allocator* allocator);
+
+// MODIFIES: the memory state
+// EFFECTS:  Sets the most bytes tracked buffers may hold at once, or
+//           removes the limit if limit is 0.
+void memory_set_limit(long long limit);
+
+// EFFECTS:  Returns the limit set by memory_set_limit (0 for none).
+long long memory_limit();
+
+// EFFECTS:  Returns the bytes tracked buffers hold now.
+long long memory_current();
+
+// EFFECTS:  Returns the most bytes tracked buffers have held at once
+//           since the start or the last memory_reset_peak.
+long long memory_peak();
+
+// MODIFIES: the memory state
+// EFFECTS:  Restarts the peak from the bytes held now.
+void memory_reset_peak();
+
+// MODIFIES: the memory state
+// EFFECTS:  Returns a tracked buffer of size bytes. Throws std::bad_alloc
+//           if it would take the bytes held past the limit or the
+//           allocator has no memory. Safe to call from several threads.
+void* memory_allocate(size_t size);
+
+// REQUIRES: pointer came from memory_allocate(size)
+// MODIFIES: the memory state
+// EFFECTS:  Gives the buffer back. Safe to call from several threads.
+void memory_release(void* pointer, size_t size);
+
+// A standard allocator that takes its memory from memory_allocate.
+template <class T>
+struct Tracked_Allocator {
+  typedef T value_type;
+
+  Tracked_Allocator() {}
+  template <class U>
+  Tracked_Allocator(const Tracked_Allocator<U>&) {}
+
+  T* allocate(size_t count) {
+    if (count > static_cast<size_t>(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(memory_allocate(count * sizeof(T)));
+  }
+  void deallocate(T* pointer, size_t count) {
+    memory_release(pointer, count * sizeof(T));
+  }
+};
+
+template <class T, class U>
+bool operator==(const Tracked_Allocator<T>&, const Tracked_Allocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const Tracked_Allocator<T>&, const Tracked_Allocator<U>&) {
+  return false;
+}
+
+// A std::vector whose buffer is tracked.
+template <class T>
+using Tracked_Vector = std::vector<T, Tracked_Allocator<T>>;
+
+#endif // MEMORY_HPP
@@ -0,0 +1,615 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include "ppm.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PPM_HAVE_MMAP 1
+#endif
+
+using namespace std;
+
+// Streams are read and written in blocks of this many bytes.
+static const size_t BLOCK_SIZE = 1 << 20;
+
+// REQUIRES: reader points to a PPM_Reader
+// MODIFIES: *reader
+// EFFECTS:  Initializes *reader to read from the given stream. The reader
+//           reads ahead in large blocks, so is may be left positioned past
+//           the end of the image.
+void PPM_Reader_init(PPM_Reader* reader, istream& is) {
+  reader->is = &is;
+  reader->buffer.resize(BLOCK_SIZE);
+  reader->cur = reader->buffer.data();
+  reader->end = reader->cur;
+  reader->mapping = nullptr;
+  reader->mapping_size = 0;
+}
+
+// REQUIRES: reader points to a PPM_Reader
+//           data points to at least size bytes that outlive the reader
+// MODIFIES: *reader
+// EFFECTS:  Initializes *reader to read from the given block of memory.
+void PPM_Reader_init(PPM_Reader* reader, const char* data, size_t size) {
+  reader->is = nullptr;
+  reader->cur = data;
+  reader->end = data + size;
+  reader->mapping = nullptr;
+  reader->mapping_size = 0;
+}
+
+// REQUIRES: reader points to a PPM_Reader
+// MODIFIES: *reader, *error
+// EFFECTS:  Initializes *reader to read from the named file, memory-mapping
+//           it where the platform allows. Returns false and sets *error if
+//           the file cannot be opened.
+bool PPM_Reader_open(PPM_Reader* reader, const char* filename,
+                     string* error) {
+#ifdef PPM_HAVE_MMAP
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    *error = string("cannot open ") + filename;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      PPM_Reader_init(reader, static_cast<const char*>(map), st.st_size);
+      reader->mapping = map;
+      reader->mapping_size = st.st_size;
+      return true;
+    }
+  }
+  close(fd);
+#endif
+
+  // not a regular file (or no mmap): fall back to buffered reads
+  reader->file.open(filename, ios::binary);
+  if (!reader->file) {
+    *error = string("cannot open ") + filename;
+    return false;
+  }
+  PPM_Reader_init(reader, reader->file);
+  return true;
+}
+
+// REQUIRES: reader points to an initialized PPM_Reader
+// MODIFIES: *reader
+// EFFECTS:  Releases the file mapping, if there is one.
+void PPM_Reader_close(PPM_Reader* reader) {
+#ifdef PPM_HAVE_MMAP
+  if (reader->mapping) {
+    munmap(reader->mapping, reader->mapping_size);
+  }
+#endif
+  reader->mapping = nullptr;
+  reader->mapping_size = 0;
+  reader->cur = reader->end = nullptr;
+  if (reader->file.is_open()) {
+    reader->file.close();
+  }
+}
+
+// Reads the next block from the stream. Returns false at end of input.
+static bool refill(PPM_Reader* reader) {
+  if (!reader->is) {
+    return false;
+  }
+  reader->is->read(reader->buffer.data(), reader->buffer.size());
+  streamsize n = reader->is->gcount();
+  if (n <= 0) {
+    return false;
+  }
+  reader->cur = reader->buffer.data();
+  reader->end = reader->cur + n;
+  return true;
+}
+
+// Makes at least n bytes available starting at reader->cur. Returns false
+// if the input ends first.
+static bool ensure(PPM_Reader* reader, size_t n) {
+  size_t have = reader->end - reader->cur;
+  if (have >= n) {
+    return true;
+  }
+  if (!reader->is) {
+    return false;
+  }
+
+  // keep the unread bytes, moving them to the front of a large enough
+  // buffer, then read more after them
+  if (reader->buffer.size() < n) {
+    vector<char> bigger(n);
+    memcpy(bigger.data(), reader->cur, have);
+    reader->buffer.swap(bigger);
+  } else {
+    memmove(reader->buffer.data(), reader->cur, have);
+  }
+  reader->cur = reader->buffer.data();
+  reader->end = reader->cur + have;
+
+  while (have < n) {
+    reader->is->read(reader->buffer.data() + have,
+                     reader->buffer.size() - have);
+    streamsize got = reader->is->gcount();
+    if (got <= 0) {
+      return false;
+    }
+    have += got;
+    reader->end = reader->cur + have;
+  }
+  return true;
+}
+
+// Returns the next byte without consuming it, or -1 at end of input.
+static inline int peek(PPM_Reader* reader) {
+  if (reader->cur == reader->end && !refill(reader)) {
+    return -1;
+  }
+  return static_cast<unsigned char>(*reader->cur);
+}
+
+static inline bool is_space(int c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+         c == '\f';
+}
+
+// Skips whitespace and comments. Returns false at end of input.
+static bool skip_space(PPM_Reader* reader) {
+  for (;;) {
+    int c = peek(reader);
+    if (c < 0) {
+      return false;
+    }
+    if (c == '#') {
+      while ((c = peek(reader)) >= 0 && c != '\n' && c != '\r') {
+        reader->cur++;
+      }
+      continue;
+    }
+    if (!is_space(c)) {
+      return true;
+    }
+    reader->cur++;
+  }
+}
+
+// Reads an unsigned decimal number no larger than limit. what names the
+// value for error messages.
+static bool read_number(PPM_Reader* reader, int limit, int* value,
+                        const char* what, string* error) {
+  if (!skip_space(reader)) {
+    *error = string("unexpected end of file while reading ") + what;
+    return false;
+  }
+
+  int c = peek(reader);
+  if (c < '0' || c > '9') {
+    *error = string("expected a number for ") + what;
+    return false;
+  }
+
+  long long v = 0;
+  do {
+    v = v * 10 + (c - '0');
+    if (v > limit) {
+      *error = string(what) + " is too large";
+      return false;
+    }
+    reader->cur++;
+    c = peek(reader);
+  } while (c >= '0' && c <= '9');
+
+  if (c >= 0 && !is_space(c) && c != '#') {
+    *error = string("unexpected character after ") + what;
+    return false;
+  }
+
+  *value = static_cast<int>(v);
+  return true;
+}
+
+// REQUIRES: reader points to an initialized PPM_Reader
+// MODIFIES: *reader, *header, *error
+// EFFECTS:  Reads a P3, P5 or P6 header (magic number, width, height and
+//           maximum value); the format is taken from the magic number.
+//           Comments starting with '#' are skipped. Returns false and sets
+//           *error if the header is malformed or unsupported.
+bool PPM_read_header(PPM_Reader* reader, PPM_Header* header, string* error) {
+  if (!skip_space(reader) || peek(reader) != 'P') {
+    *error = "not a PPM file (missing magic number)";
+    return false;
+  }
+  reader->cur++;
+  int kind = peek(reader);
+  if (kind == '3') {
+    header->format = PPM_P3;
+  } else if (kind == '5') {
+    header->format = PPM_P5;
+  } else if (kind == '6') {
+    header->format = PPM_P6;
+  } else {
+    *error = "unsupported format (only P3, P5 and P6 are supported)";
+    return false;
+  }
+  reader->cur++;
+  int c = peek(reader);
+  if (c >= 0 && !is_space(c) && c != '#') {
+    *error = "not a PPM file (bad magic number)";
+    return false;
+  }
+
+  if (!read_number(reader, INT_MAX, &header->width, "width", error) ||
+      !read_number(reader, INT_MAX, &header->height, "height", error) ||
+      !read_number(reader, INT_MAX, &header->max_value, "maximum value",
+                   error)) {
+    return false;
+  }
+
+  if (header->width <= 0 || header->height <= 0) {
+    *error = "image width and height must be positive";
+    return false;
+  }
+  if (header->max_value <= 0 || header->max_value > 255) {
+    *error = "maximum value must be between 1 and 255";
+    return false;
+  }
+
+  // in the binary formats a single whitespace character separates the
+  // header from the raster, which may itself start with whitespace bytes
+  if (header->format != PPM_P3) {
+    if (!is_space(peek(reader))) {
+      *error = "missing whitespace after the header";
+      return false;
+    }
+    reader->cur++;
+  }
+
+  return true;
+}
+
+// Reads one row of an ASCII (P3) image.
+static bool read_ascii_row(PPM_Reader* reader, const PPM_Header* header,
+                           unsigned char* red, unsigned char* green,
+                           unsigned char* blue, string* error) {
+  const int limit = header->max_value;
+  int r;
+  int g;
+  int b;
+
+  for (int j = 0; j < header->width; j++) {
+    if (!read_number(reader, limit, &r, "pixel value", error) ||
+        !read_number(reader, limit, &g, "pixel value", error) ||
+        !read_number(reader, limit, &b, "pixel value", error)) {
+      return false;
+    }
+    red[j] = static_cast<unsigned char>(r);
+    green[j] = static_cast<unsigned char>(g);
+    blue[j] = static_cast<unsigned char>(b);
+  }
+
+  return true;
+}
+
+// Reads one row of a binary (P5 or P6) image.
+static bool read_binary_row(PPM_Reader* reader, const PPM_Header* header,
+                            unsigned char* red, unsigned char* green,
+                            unsigned char* blue, string* error) {
+  const int width = header->width;
+  const int channels = header->format == PPM_P6 ? 3 : 1;
+  const size_t size = static_cast<size_t>(width) * channels;
+
+  if (!ensure(reader, size)) {
+    *error = "unexpected end of file while reading pixel data";
+    return false;
+  }
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(reader->cur);
+
+  if (header->max_value < 255) {
+    for (size_t k = 0; k < size; k++) {
+      if (in[k] > header->max_value) {
+        *error = "pixel value is too large";
+        return false;
+      }
+    }
+  }
+
+  if (channels == 3) {
+    for (int j = 0; j < width; j++) {
+      red[j] = in[3 * j];
+      green[j] = in[3 * j + 1];
+      blue[j] = in[3 * j + 2];
+    }
+  } else {
+    // green and blue are null when the row is read as one gray channel
+    memcpy(red, in, width);
+    if (green) {
+      memcpy(green, in, width);
+      memcpy(blue, in, width);
+    }
+  }
+
+  reader->cur += size;
+  return true;
+}
+
+// REQUIRES: reader points to a PPM_Reader positioned at a row of pixels
+//           header is the header that was read from reader
+//           red, green and blue each have room for header->width values
+// MODIFIES: *reader, red, green, blue, *error
+// EFFECTS:  Reads the next row of pixels, storing each channel in its own
+//           array. Values are stored as they appear in the file; a
+//           grayscale value is stored in all three channels. Binary rows
+//           are decoded directly from the mapped file when there is one.
+//           Returns false and sets *error if the data is malformed or
+//           truncated, or a value is larger than the header's maximum.
+bool PPM_read_row(PPM_Reader* reader, const PPM_Header* header,
+                  unsigned char* red, unsigned char* green,
+                  unsigned char* blue, string* error) {
+  if (header->format == PPM_P3) {
+    return read_ascii_row(reader, header, red, green, blue, error);
+  }
+  return read_binary_row(reader, header, red, green, blue, error);
+}
+
+// REQUIRES: reader points to a PPM_Reader positioned at a row of pixels
+//           header is the header that was read from reader, and its format
+//           is PPM_P5
+//           gray has room for header->width values
+// MODIFIES: *reader, gray, *error
+// EFFECTS:  Same as PPM_read_row, but stores the values of a grayscale
+//           row once, in gray.
+bool PPM_read_gray_row(PPM_Reader* reader, const PPM_Header* header,
+                       unsigned char* gray, string* error) {
+  return read_binary_row(reader, header, gray, nullptr, nullptr, error);
+}
+
+// REQUIRES: reader points to a PPM_Reader positioned at a row of pixels
+//           header is the header that was read from reader
+//           0 <= rows
+// MODIFIES: *reader, *error
+// EFFECTS:  Moves past the next rows rows of pixels without storing them.
+//           Binary rows are skipped without being read where the stream
+//           can seek; ASCII rows are still parsed and checked. Returns
+//           false and sets *error if the data ends first or is malformed.
+bool PPM_skip_rows(PPM_Reader* reader, const PPM_Header* header, int rows,
+                   string* error) {
+  if (header->format == PPM_P3) {
+    vector<unsigned char> scratch(header->width);
+    for (int i = 0; i < rows; i++) {
+      if (!read_ascii_row(reader, header, scratch.data(), scratch.data(),
+                          scratch.data(), error)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const int channels = header->format == PPM_P6 ? 3 : 1;
+  unsigned long long skip = static_cast<unsigned long long>(header->width) *
+                            channels * rows;
+  size_t have = reader->end - reader->cur;
+  if (skip <= have) {
+    reader->cur += skip;
+    return true;
+  }
+  skip -= have;
+  reader->cur = reader->end;
+
+  // past the buffered bytes: seek, or read and drop what can't be sought
+  if (reader->is) {
+    reader->is->clear();
+    if (reader->is->seekg(static_cast<streamoff>(skip), ios::cur)) {
+      return true;
+    }
+    reader->is->clear();
+    while (skip > 0 && refill(reader)) {
+      size_t got = reader->end - reader->cur;
+      size_t used = static_cast<size_t>(min<unsigned long long>(skip, got));
+      reader->cur += used;
+      skip -= used;
+    }
+  }
+  if (skip > 0) {
+    *error = "unexpected end of file while reading pixel data";
+    return false;
+  }
+  return true;
+}
+
+// Text for each value 0-255 followed by a space, and its length.
+struct Formatted_Value {
+  char text[8];
+  int length;
+};
+
+struct Value_Table {
+  Formatted_Value values[256];
+};
+
+static Value_Table build_value_table() {
+  Value_Table table;
+  for (int v = 0; v < 256; v++) {
+    table.values[v].length = snprintf(table.values[v].text,
+                                      sizeof(table.values[v].text), "%d ", v);
+  }
+  return table;
+}
+
+// Hands the buffered output to the stream.
+static void flush_buffer(PPM_Writer* writer) {
+  writer->os->write(writer->buffer.data(), writer->used);
+  writer->used = 0;
+}
+
+// Makes room for at least n more bytes in the buffer.
+static void reserve(PPM_Writer* writer, size_t n) {
+  if (writer->used + n > writer->buffer.size()) {
+    flush_buffer(writer);
+    if (n > writer->buffer.size()) {
+      writer->buffer.resize(n);
+    }
+  }
+}
+
+// REQUIRES: writer points to a PPM_Writer
+// MODIFIES: *writer
+// EFFECTS:  Initializes *writer to write to the given stream.
+void PPM_Writer_init(PPM_Writer* writer, ostream& os) {
+  writer->os = &os;
+  writer->buffer.resize(BLOCK_SIZE);
+  writer->used = 0;
+}
+
+// REQUIRES: writer points to an initialized PPM_Writer
+// MODIFIES: *writer
+// EFFECTS:  Writes a header in the given format for an image of the
+//           given size:
+//             MAGIC [newline]
+//             WIDTH [space] HEIGHT [newline]
+//             255 [newline]
+//           where MAGIC is P3, P5 or P6. Rows written afterwards use the
+//           same format.
+void PPM_write_header(PPM_Writer* writer, PPM_Format format, int width,
+                      int height) {
+  static const char* const magic[] = { "P3", "P5", "P6" };
+
+  writer->format = format;
+  reserve(writer, 64);
+  writer->used += snprintf(writer->buffer.data() + writer->used, 64,
+                           "%s\n%d %d\n255\n", magic[format], width, height);
+}
+
+// Formats one row as ASCII (P3) text.
+static void write_ascii_row(PPM_Writer* writer, const unsigned char* red,
+                            const unsigned char* green,
+                            const unsigned char* blue, int width) {
+  static const Value_Table formatted = build_value_table();
+  const Formatted_Value* table = formatted.values;
+
+  // at most 4 bytes per value plus the newline
+  reserve(writer, static_cast<size_t>(width) * 12 + 1);
+  char* out = writer->buffer.data() + writer->used;
+
+  for (int j = 0; j < width; j++) {
+    const Formatted_Value& r = table[red[j]];
+    const Formatted_Value& g = table[green[j]];
+    const Formatted_Value& b = table[blue[j]];
+    memcpy(out, r.text, 4);
+    out += r.length;
+    memcpy(out, g.text, 4);
+    out += g.length;
+    memcpy(out, b.text, 4);
+    out += b.length;
+  }
+  *out++ = '\n';
+
+  writer->used = out - writer->buffer.data();
+}
+
+// REQUIRES: writer points to a PPM_Writer whose header has been written
+//           red, green and blue each hold width values
+// MODIFIES: *writer
+// EFFECTS:  Writes one row of pixels. In P3, each pixel is written as its
+//           red, green and blue values, each followed by a space, and the
+//           row is followed by a newline. In P6, each pixel is three bytes.
+//           In P5, each pixel is one byte holding its luma (the ITU-R
+//           BT.601 weighted sum, rounded), so gray pixels keep their value.
+void PPM_write_row(PPM_Writer* writer, const unsigned char* red,
+                   const unsigned char* green, const unsigned char* blue,
+                   int width) {
+  if (writer->format == PPM_P3) {
+    write_ascii_row(writer, red, green, blue, width);
+    return;
+  }
+
+  if (writer->format == PPM_P6) {
+    reserve(writer, static_cast<size_t>(width) * 3);
+    unsigned char* out = reinterpret_cast<unsigned char*>(
+        writer->buffer.data() + writer->used);
+    for (int j = 0; j < width; j++) {
+      out[3 * j] = red[j];
+      out[3 * j + 1] = green[j];
+      out[3 * j + 2] = blue[j];
+    }
+    writer->used += static_cast<size_t>(width) * 3;
+  } else {
+    reserve(writer, width);
+    unsigned char* out = reinterpret_cast<unsigned char*>(
+        writer->buffer.data() + writer->used);
+    PPM_luma_row(red, green, blue, out, width);
+    writer->used += width;
+  }
+}
+
+// REQUIRES: writer points to a PPM_Writer whose header has been written
+//           gray holds width values
+// MODIFIES: *writer
+// EFFECTS:  Writes one row of gray pixels. The output is what
+//           PPM_write_row writes with gray as all three channels: in P5
+//           each value is written as it is.
+void PPM_write_gray_row(PPM_Writer* writer, const unsigned char* gray,
+                        int width) {
+  if (writer->format != PPM_P5) {
+    PPM_write_row(writer, gray, gray, gray, width);
+    return;
+  }
+  reserve(writer, width);
+  memcpy(writer->buffer.data() + writer->used, gray, width);
+  writer->used += width;
+}
+
+// REQUIRES: red, green and blue each hold width values
+//           luma has room for width values
+// MODIFIES: luma
+// EFFECTS:  Sets luma[j] to the luma of pixel j, the ITU-R BT.601
+//           weighted sum of its channels, rounded, as P5 output stores it.
+void PPM_luma_row(const unsigned char* red, const unsigned char* green,
+                  const unsigned char* blue, unsigned char* luma, int width) {
+  for (int j = 0; j < width; j++) {
+    luma[j] = static_cast<unsigned char>(
+        (299 * red[j] + 587 * green[j] + 114 * blue[j] + 500) / 1000);
+  }
+}
+
+// REQUIRES: writer points to an initialized PPM_Writer
+// MODIFIES: *writer, the stream
+// EFFECTS:  Hands any buffered output to the stream and flushes it.
+//           Returns false if the stream reported an error.
+bool PPM_Writer_finish(PPM_Writer* writer) {
+  flush_buffer(writer);
+  writer->os->flush();
+  return static_cast<bool>(*writer->os);
+}
+
+// REQUIRES: name points to a C string
+// MODIFIES: *format
+// EFFECTS:  Parses a format name ("p3", "p5", "p6", in either case) into
+//           *format. Returns false if the name is not recognized.
+bool PPM_parse_format(const char* name, PPM_Format* format) {
+  if (strlen(name) != 2 || (name[0] != 'p' && name[0] != 'P')) {
+    return false;
+  }
+  switch (name[1]) {
+  case '3':
+    *format = PPM_P3;
+    return true;
+  case '5':
+    *format = PPM_P5;
+    return true;
+  case '6':
+    *format = PPM_P6;
+    return true;
+  default:
+    return false;
+  }
+}
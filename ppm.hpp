@@ -0,0 +1,183 @@
+#ifndef PPM_HPP
+#define PPM_HPP
+
+/* ppm.hpp
+ * Reading and writing of images in PPM format (and its grayscale sibling,
+ * PGM), fast enough that parsing and formatting do not dominate the time
+ * spent on large images.
+ */
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// File formats, named after their magic numbers.
+enum PPM_Format {
+  PPM_P3,  // ASCII RGB
+  PPM_P5,  // binary grayscale (PGM)
+  PPM_P6   // binary RGB
+};
+
+// Header of a PPM image.
+struct PPM_Header {
+  PPM_Format format;
+  int width;
+  int height;
+  int max_value;
+};
+
+// Source of bytes for the PPM parser. Bytes come either from a block of
+// memory (such as a memory-mapped file), or from an input stream that is
+// read through a large buffer.
+// PPM_Reader objects must not be copied.
+struct PPM_Reader {
+  std::istream* is;          // stream to refill from, or null
+  std::ifstream file;        // used by PPM_Reader_open if mapping fails
+  std::vector<char> buffer;  // holds the bytes read from is
+  const char* cur;           // next unread byte
+  const char* end;           // one past the last available byte
+  void* mapping;             // memory-mapped file, or null
+  std::size_t mapping_size;
+};
+
+// REQUIRES: reader points to a PPM_Reader
+// MODIFIES: *reader
+// EFFECTS:  Initializes *reader to read from the given stream. The reader
+//           reads ahead in large blocks, so is may be left positioned past
+//           the end of the image.
+void PPM_Reader_init(PPM_Reader* reader, std::istream& is);
+
+// REQUIRES: reader points to a PPM_Reader
+//           data points to at least size bytes that outlive the reader
+// MODIFIES: *reader
+// EFFECTS:  Initializes *reader to read from the given block of memory.
+void PPM_Reader_init(PPM_Reader* reader, const char* data, std::size_t size);
+
+// REQUIRES: reader points to a PPM_Reader
+// MODIFIES: *reader, *error
+// EFFECTS:  Initializes *reader to read from the named file, memory-mapping
+//           it where the platform allows. Returns false and sets *error if
+//           the file cannot be opened.
+bool PPM_Reader_open(PPM_Reader* reader, const char* filename,
+                     std::string* error);
+
+// REQUIRES: reader points to an initialized PPM_Reader
+// MODIFIES: *reader
+// EFFECTS:  Releases the file mapping, if there is one.
+void PPM_Reader_close(PPM_Reader* reader);
+
+// REQUIRES: reader points to an initialized PPM_Reader
+// MODIFIES: *reader, *header, *error
+// EFFECTS:  Reads a P3, P5 or P6 header (magic number, width, height and
+//           maximum value); the format is taken from the magic number.
+//           Comments starting with '#' are skipped. Returns false and sets
+//           *error if the header is malformed or unsupported.
+bool PPM_read_header(PPM_Reader* reader, PPM_Header* header,
+                     std::string* error);
+
+// REQUIRES: reader points to a PPM_Reader positioned at a row of pixels
+//           header is the header that was read from reader
+//           red, green and blue each have room for header->width values
+// MODIFIES: *reader, red, green, blue, *error
+// EFFECTS:  Reads the next row of pixels, storing each channel in its own
+//           array. Values are stored as they appear in the file; a
+//           grayscale value is stored in all three channels. Binary rows
+//           are decoded directly from the mapped file when there is one.
+//           Returns false and sets *error if the data is malformed or
+//           truncated, or a value is larger than the header's maximum.
+bool PPM_read_row(PPM_Reader* reader, const PPM_Header* header,
+                  unsigned char* red, unsigned char* green,
+                  unsigned char* blue, std::string* error);
+
+// REQUIRES: reader points to a PPM_Reader positioned at a row of pixels
+//           header is the header that was read from reader, and its format
+//           is PPM_P5
+//           gray has room for header->width values
+// MODIFIES: *reader, gray, *error
+// EFFECTS:  Same as PPM_read_row, but stores the values of a grayscale
+//           row once, in gray.
+bool PPM_read_gray_row(PPM_Reader* reader, const PPM_Header* header,
+                       unsigned char* gray, std::string* error);
+
+// REQUIRES: reader points to a PPM_Reader positioned at a row of pixels
+//           header is the header that was read from reader
+//           0 <= rows
+// MODIFIES: *reader, *error
+// EFFECTS:  Moves past the next rows rows of pixels without storing them.
+//           Binary rows are skipped without being read where the stream
+//           can seek; ASCII rows are still parsed and checked. Returns
+//           false and sets *error if the data ends first or is malformed.
+bool PPM_skip_rows(PPM_Reader* reader, const PPM_Header* header, int rows,
+                   std::string* error);
+
+// Buffered writer for PPM output. Text is formatted into a large buffer
+// that is handed to the stream in big blocks.
+// PPM_Writer objects must not be copied.
+struct PPM_Writer {
+  std::ostream* os;
+  PPM_Format format;  // set by PPM_write_header
+  std::vector<char> buffer;
+  std::size_t used;
+};
+
+// REQUIRES: writer points to a PPM_Writer
+// MODIFIES: *writer
+// EFFECTS:  Initializes *writer to write to the given stream.
+void PPM_Writer_init(PPM_Writer* writer, std::ostream& os);
+
+// REQUIRES: writer points to an initialized PPM_Writer
+// MODIFIES: *writer
+// EFFECTS:  Writes a header in the given format for an image of the
+//           given size:
+//             MAGIC [newline]
+//             WIDTH [space] HEIGHT [newline]
+//             255 [newline]
+//           where MAGIC is P3, P5 or P6. Rows written afterwards use the
+//           same format.
+void PPM_write_header(PPM_Writer* writer, PPM_Format format, int width,
+                      int height);
+
+// REQUIRES: writer points to a PPM_Writer whose header has been written
+//           red, green and blue each hold width values
+// MODIFIES: *writer
+// EFFECTS:  Writes one row of pixels. In P3, each pixel is written as its
+//           red, green and blue values, each followed by a space, and the
+//           row is followed by a newline. In P6, each pixel is three bytes.
+//           In P5, each pixel is one byte holding its luma (the ITU-R
+//           BT.601 weighted sum, rounded), so gray pixels keep their value.
+void PPM_write_row(PPM_Writer* writer, const unsigned char* red,
+                   const unsigned char* green, const unsigned char* blue,
+                   int width);
+
+// REQUIRES: writer points to a PPM_Writer whose header has been written
+//           gray holds width values
+// MODIFIES: *writer
+// EFFECTS:  Writes one row of gray pixels. The output is what
+//           PPM_write_row writes with gray as all three channels: in P5
+//           each value is written as it is.
+void PPM_write_gray_row(PPM_Writer* writer, const unsigned char* gray,
+                        int width);
+
+// REQUIRES: red, green and blue each hold width values
+//           luma has room for width values
+// MODIFIES: luma
+// EFFECTS:  Sets luma[j] to the luma of pixel j, the ITU-R BT.601
+//           weighted sum of its channels, rounded, as P5 output stores it.
+void PPM_luma_row(const unsigned char* red, const unsigned char* green,
+                  const unsigned char* blue, unsigned char* luma, int width);
+
+// REQUIRES: writer points to an initialized PPM_Writer
+// MODIFIES: *writer, the stream
+// EFFECTS:  Hands any buffered output to the stream and flushes it.
+//           Returns false if the stream reported an error.
+bool PPM_Writer_finish(PPM_Writer* writer);
+
+// REQUIRES: name points to a C string
+// MODIFIES: *format
+// EFFECTS:  Parses a format name ("p3", "p5", "p6", in either case) into
+//           *format. Returns false if the name is not recognized.
+bool PPM_parse_format(const char* name, PPM_Format* format);
+
+#endif // PPM_HPP
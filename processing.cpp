@@ -1,59 +1,220 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <vector>
 #include "processing.hpp"
+#include "crop.hpp"
+#include "energy_kernels.hpp"
+#include "ThreadPool.hpp"
+#include "step_kernels.hpp"
+#include "transpose_kernels.hpp"
+#include "profile.hpp"
 
 //written by Ian Kim 
 
 using namespace std;
 
+// Tiles are visited in blocks of ROTATE_BLOCK x ROTATE_BLOCK pixels, so
+// the destination rows a block writes to fill whole cache lines before
+// they are evicted.
+static const int ROTATE_BLOCK = 64;
+
+// Writes channel ch of src, rotated 90 degrees to the left (or to the
+// right if left is false), into channel ch of dst.
+static void rotate_plane(const Image* src, Image* dst, int ch, bool left) {
+  const int width = Image_width(src);
+  const int height = Image_height(src);
+  const int fullRows = height - height % TRANSPOSE_TILE;
+  const int fullCols = width - width % TRANSPOSE_TILE;
+
+  // a left rotation is a transpose written bottom to top; a right
+  // rotation transposes the source rows in reverse order
+  const unsigned char* srcPlane = Image_row(src, ch, 0);
+  unsigned char* dstPlane = Image_row(dst, ch, 0);
+  const long srcStride = src->stride;
+  const long dstStride = dst->stride;
+
+  const unsigned char* in[TRANSPOSE_TILE];
+  unsigned char* out[TRANSPOSE_TILE];
+  for (int r0 = 0; r0 < fullRows; r0 += ROTATE_BLOCK) {
+    for (int c0 = 0; c0 < fullCols; c0 += ROTATE_BLOCK) {
+      const int rEnd = std::min(r0 + ROTATE_BLOCK, fullRows);
+      const int cEnd = std::min(c0 + ROTATE_BLOCK, fullCols);
+      for (int r = r0; r < rEnd; r += TRANSPOSE_TILE) {
+        for (int c = c0; c < cEnd; c += TRANSPOSE_TILE) {
+          for (int k = 0; k < TRANSPOSE_TILE; k++) {
+            if (left) {
+              in[k] = srcPlane + (r + k) * srcStride + c;
+              out[k] = dstPlane + (width - 1 - c - k) * dstStride + r;
+            } else {
+              in[k] = srcPlane + (r + TRANSPOSE_TILE - 1 - k) * srcStride + c;
+              out[k] = dstPlane + (c + k) * dstStride + height - TRANSPOSE_TILE - r;
+            }
+          }
+          transpose_tile(in, out);
+        }
+      }
+    }
+  }
+
+  // the right and bottom strips that do not fill a whole tile
+  for (int r = 0; r < height; r++) {
+    const unsigned char* row = Image_row(src, ch, r);
+    for (int c = r < fullRows ? fullCols : 0; c < width; c++) {
+      if (left) {
+        Image_row(dst, ch, width - 1 - c)[r] = row[c];
+      } else {
+        Image_row(dst, ch, c)[height - 1 - r] = row[c];
+      }
+    }
+  }
+}
+
+// Transposes channel ch of a square image in place: tiles on the diagonal
+// are transposed where they are and the others are swapped with their
+// mirror image.
+static void transpose_square_plane(Image* img, int ch) {
+  const int n = Image_width(img);
+  const int full = n - n % TRANSPOSE_TILE;
+
+  unsigned char buffer[TRANSPOSE_TILE * TRANSPOSE_TILE];
+  unsigned char* temp[TRANSPOSE_TILE];
+  for (int k = 0; k < TRANSPOSE_TILE; k++) {
+    temp[k] = buffer + k * TRANSPOSE_TILE;
+  }
+
+  unsigned char* a[TRANSPOSE_TILE];
+  unsigned char* b[TRANSPOSE_TILE];
+  for (int r = 0; r < full; r += TRANSPOSE_TILE) {
+    for (int c = r; c < full; c += TRANSPOSE_TILE) {
+      for (int k = 0; k < TRANSPOSE_TILE; k++) {
+        a[k] = Image_row(img, ch, r + k) + c;
+        b[k] = Image_row(img, ch, c + k) + r;
+      }
+      if (c == r) {
+        transpose_tile(a, a);
+        continue;
+      }
+      transpose_tile(a, temp);
+      transpose_tile(b, a);
+      for (int k = 0; k < TRANSPOSE_TILE; k++) {
+        std::memcpy(b[k], temp[k], TRANSPOSE_TILE);
+      }
+    }
+  }
+
+  // pairs with a coordinate in the strip that does not fill a whole tile
+  for (int r = 0; r < n; r++) {
+    unsigned char* row = Image_row(img, ch, r);
+    for (int c = std::max(r + 1, full); c < n; c++) {
+      std::swap(row[c], Image_row(img, ch, c)[r]);
+    }
+  }
+}
+
+// Reverses the order of the rows of channel ch.
+static void flip_plane(Image* img, int ch) {
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  for (int r = 0; r < height / 2; r++) {
+    unsigned char* top = Image_row(img, ch, r);
+    std::swap_ranges(top, top + width, Image_row(img, ch, height - 1 - r));
+  }
+}
+
 void rotate_left(Image* img) {
+  PROFILE_SCOPE(PROFILE_ROTATE, Image_bytes(img));
 
-  // for convenience
-  int width = Image_width(img);
-  int height = Image_height(img);
+  // a square image is rotated in place: transpose, then flip
+  if (Image_width(img) == Image_height(img)) {
+    for (int ch = 0; ch < Image_channels(img); ++ch) {
+      transpose_square_plane(img, ch);
+      flip_plane(img, ch);
+    }
+    return;
+  }
 
-  // auxiliary image to temporarily store rotated image
+  // auxiliary image to hold the rotated image
   Image aux;
-  Image_init(&aux, height, width); // width and height switched
+  Image_init(&aux, Image_height(img), Image_width(img),
+             Image_channels(img)); // width and height switched
 
-  // iterate through pixels and place each where it goes in temp
-  for (int r = 0; r < height; ++r) {
-    for (int c = 0; c < width; ++c) {
-      Image_set_pixel(&aux, width - 1 - c, r, Image_get_pixel(img, r, c));
-    }
+  for (int ch = 0; ch < Image_channels(img); ++ch) {
+    rotate_plane(img, &aux, ch, true);
   }
 
-  // Copy data back into original
-  *img = aux;
+  std::swap(*img, aux);
 }
 
 void rotate_right(Image* img){
+  PROFILE_SCOPE(PROFILE_ROTATE, Image_bytes(img));
 
-  // for convenience
-  int width = Image_width(img);
-  int height = Image_height(img);
+  // a square image is rotated in place: flip, then transpose
+  if (Image_width(img) == Image_height(img)) {
+    for (int ch = 0; ch < Image_channels(img); ++ch) {
+      flip_plane(img, ch);
+      transpose_square_plane(img, ch);
+    }
+    return;
+  }
 
-  // auxiliary image to temporarily store rotated image
+  // auxiliary image to hold the rotated image
   Image aux;
-  Image_init(&aux, height, width); // width and height switched
+  Image_init(&aux, Image_height(img), Image_width(img),
+             Image_channels(img)); // width and height switched
 
-  // iterate through pixels and place each where it goes in temp
-  for (int r = 0; r < height; ++r) {
-    for (int c = 0; c < width; ++c) {
-      Image_set_pixel(&aux, c, height - 1 - r, Image_get_pixel(img, r, c));
-    }
+  for (int ch = 0; ch < Image_channels(img); ++ch) {
+    rotate_plane(img, &aux, ch, false);
+  }
+
+  std::swap(*img, aux);
+}
+
+// REQUIRES: view points to a valid Image_View, dst points to an Image
+//           dst is not view->img
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to an upright copy of what the view shows,
+//           with the same tiled loops as rotate_left and rotate_right.
+//           This is the only view function that copies the image.
+void materialize_view(const Image_View* view, Image* dst) {
+  const Image* img = view->img;
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  PROFILE_SCOPE(PROFILE_ROTATE, Image_bytes(img));
+  if (view->turns == 0) {
+    *dst = *img;
+    return;
   }
 
-  *img = aux;
+  Image_init(dst, Image_View_width(view), Image_View_height(view),
+             Image_channels(img));
+  for (int ch = 0; ch < Image_channels(img); ++ch) {
+    if (view->turns == 2) {
+      for (int r = 0; r < height; r++) {
+        const unsigned char* in = Image_row(img, ch, height - 1 - r);
+        std::reverse_copy(in, in + width, Image_row(dst, ch, r));
+      }
+    } else {
+      rotate_plane(img, dst, ch, view->turns == 1);
+    }
+  }
 }
 
-static int squared_difference(Pixel p1, Pixel p2) {
-  int dr = p2.r - p1.r;
-  int dg = p2.g - p1.g;
-  int db = p2.b - p1.b;
-  // Divide by 100 is to avoid possible overflows
-  // later on in the algorithm.
-  return (dr*dr + dg*dg + db*db) / 100;
+// Computes the energy of the interior pixels in columns [lo, hi] of row i
+// and writes them to out[lo..hi], using the fastest kernel the CPU
+// supports for the image's channel count. Shared by compute_energy_matrix
+// and the incremental update in seam_carve_width so both agree exactly.
+static void energy_row(const Image* img, int i, int lo, int hi, int* out) {
+  const unsigned char* above[IMAGE_CHANNELS];
+  const unsigned char* row[IMAGE_CHANNELS];
+  const unsigned char* below[IMAGE_CHANNELS];
+  for (int ch = 0; ch < Image_channels(img); ch++) {
+    above[ch] = Image_row(img, ch, i - 1);
+    row[ch] = Image_row(img, ch, i);
+    below[ch] = Image_row(img, ch, i + 1);
+  }
+
+  energy_compute_row(above, row, below, Image_channels(img), lo, hi, out);
 }
 
 
@@ -65,12 +226,164 @@ static int squared_difference(Pixel p1, Pixel p2) {
 //           size as the given Image, and then the energy matrix for that
 //           image is computed and written into it.
 void compute_energy_matrix(const Image* img, Matrix* energy) {
-  Matrix_init(energy, Image_width(img), Image_height(img));
+  PROFILE_SCOPE(PROFILE_ENERGY, Image_bytes(img));
+  // every interior element is written below; the border starts out as 0
+  // so it does not affect the maximum
+  Matrix_reshape(energy, Image_width(img), Image_height(img));
+  Matrix_fill_border(energy, 0);
 
   for (int i = 1; i < Image_height(img) - 1; i++) {
-    for (int j = 1; j < Image_width(img) - 1; j++) {
-      *Matrix_at(energy, i, j) = squared_difference(Image_get_pixel(img, i - 1, j), Image_get_pixel(img, i + 1, j)) + 
-      squared_difference(Image_get_pixel(img, i, j - 1), Image_get_pixel(img, i, j + 1));
+    energy_row(img, i, 1, Image_width(img) - 2, Matrix_at(energy, i, 0));
+  }
+
+  int curMax = Matrix_max(energy);
+  Matrix_fill_border(energy, curMax);
+}
+
+// Image rows whose energies are gathered before being written out
+// column by column; 16 ints fill one cache line of the output.
+static const int TRANSPOSE_BLOCK_ROWS = 16;
+
+// Access to the two kinds of energy matrix for the templates below.
+static void energy_reshape(Matrix* energy, int width, int height) {
+  Matrix_reshape(energy, width, height);
+}
+
+static void energy_reshape(Compact_Matrix* energy, int width, int height) {
+  Compact_Matrix_reshape(energy, width, height);
+}
+
+static int* energy_row_at(Matrix* energy, int row) {
+  return Matrix_at(energy, row, 0);
+}
+
+static uint16_t* energy_row_at(Compact_Matrix* energy, int row) {
+  return Compact_Matrix_row(energy, row);
+}
+
+static void energy_fill_border(Matrix* energy, int value) {
+  Matrix_fill_border(energy, value);
+}
+
+static void energy_fill_border(Compact_Matrix* energy, int value) {
+  Compact_Matrix_fill_border(energy, static_cast<uint16_t>(value));
+}
+
+// The energy matrix of img turned sideways: of the image rotated left if
+// left is true (as compute_horizontal_energy_matrix), and of the image
+// rotated right otherwise. block is scratch space. Energy_Matrix is
+// Matrix or Compact_Matrix; energies never exceed ENERGY_MAX, so they
+// fit either.
+template <class Energy_Matrix>
+static void sideways_energy(const Image* img, Energy_Matrix* energy,
+                            vector<int> &block, bool left) {
+  PROFILE_SCOPE(PROFILE_ENERGY, Image_bytes(img));
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  energy_reshape(energy, height, width);
+  energy_fill_border(energy, 0);
+
+  // rows are computed with the vector kernels into a small block, then
+  // each column of the block is written out as one contiguous run
+  block.resize(TRANSPOSE_BLOCK_ROWS * width);
+  int curMax = 0;
+  for (int top = 1; top < height - 1; top += TRANSPOSE_BLOCK_ROWS) {
+    const int rows = std::min(TRANSPOSE_BLOCK_ROWS, height - 1 - top);
+    for (int k = 0; k < rows; k++) {
+      energy_row(img, top + k, 1, width - 2, &block[k * width]);
+    }
+    for (int c = 1; c < width - 1; c++) {
+      if (left) {
+        auto* out = energy_row_at(energy, width - 1 - c) + top;
+        for (int k = 0; k < rows; k++) {
+          out[k] = block[k * width + c];
+          curMax = std::max(curMax, block[k * width + c]);
+        }
+      } else {
+        auto* out = energy_row_at(energy, c) + height - 1 - top;
+        for (int k = 0; k < rows; k++) {
+          out[-k] = block[k * width + c];
+          curMax = std::max(curMax, block[k * width + c]);
+        }
+      }
+    }
+  }
+
+  energy_fill_border(energy, curMax);
+}
+
+// compute_energy_matrix into 16-bit energies, one row at a time through
+// row, without a 32-bit matrix.
+static void compact_energy(const Image* img, Compact_Matrix* energy,
+                           vector<int> &row) {
+  PROFILE_SCOPE(PROFILE_ENERGY, Image_bytes(img));
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  Compact_Matrix_reshape(energy, width, height);
+  Compact_Matrix_fill_border(energy, 0);
+
+  row.resize(width);
+  int curMax = 0;
+  for (int i = 1; i < height - 1; i++) {
+    energy_row(img, i, 1, width - 2, row.data());
+    uint16_t* out = Compact_Matrix_row(energy, i);
+    for (int j = 1; j < width - 1; j++) {
+      out[j] = static_cast<uint16_t>(row[j]);
+      curMax = std::max(curMax, row[j]);
+    }
+  }
+  Compact_Matrix_fill_border(energy, static_cast<uint16_t>(curMax));
+}
+
+// compute_horizontal_energy_matrix, with block as scratch space.
+static void horizontal_energy(const Image* img, Matrix* energy,
+                              vector<int> &block) {
+  sideways_energy(img, energy, block, true);
+}
+
+// REQUIRES: img points to a valid Image.
+//           energy points to a Matrix.
+// MODIFIES: *energy
+// EFFECTS:  Like compute_energy_matrix, but lays the energies out for
+//           horizontal seams: row i of *energy holds image column
+//           Image_width(img) - 1 - i, top to bottom. This is the energy
+//           matrix of the image rotated left, so a horizontal seam of the
+//           image is a vertical seam of *energy. The image itself is read
+//           in place.
+void compute_horizontal_energy_matrix(const Image* img, Matrix* energy) {
+  vector<int> block;
+  horizontal_energy(img, energy, block);
+}
+
+// REQUIRES: view points to a valid Image_View, energy points to a Matrix
+// MODIFIES: *energy
+// EFFECTS:  Same as materializing the view and calling
+//           compute_energy_matrix on the copy, but reads the image in
+//           place, row by row, whichever way the view is turned.
+void compute_energy_matrix_view(const Image_View* view, Matrix* energy) {
+  const Image* img = view->img;
+  vector<int> block;
+  if (view->turns == 0) {
+    compute_energy_matrix(img, energy);
+    return;
+  }
+  if (view->turns != 2) {
+    sideways_energy(img, energy, block, view->turns == 1);
+    return;
+  }
+
+  // upside down: each row of the image, reversed
+  PROFILE_SCOPE(PROFILE_ENERGY, Image_bytes(img));
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  Matrix_reshape(energy, width, height);
+  Matrix_fill_border(energy, 0);
+  block.resize(width);
+  for (int i = 1; i < height - 1; i++) {
+    energy_row(img, height - 1 - i, 1, width - 2, block.data());
+    int* out = Matrix_at(energy, i, 0);
+    for (int j = 1; j < width - 1; j++) {
+      out[j] = block[width - 1 - j];
     }
   }
 
@@ -79,6 +392,135 @@ void compute_energy_matrix(const Image* img, Matrix* energy) {
 }
 
 
+// Minimum of prev[left, right), where [left, right) is the window of the
+// row above that the cost of column j looks at:
+// [max(0, j - 1), min(width - 1, j + 2)). An empty window (width == 1)
+// yields prev[left], as Matrix_min_value_in_row does.
+static inline int window_min(const int* prev, int width, int j) {
+  int left = std::max(0, j - 1);
+  int right = std::min(width - 1, j + 2);
+
+  int best = prev[left];
+  for (int k = left + 1; k < right; k++) {
+    best = std::min(best, prev[k]);
+  }
+  return best;
+}
+
+// Cost of a single cell in row i >= 1, given that row i - 1 of cost is
+// already filled in.
+static int cost_at(const Matrix* energy, const Matrix* cost, int i, int j) {
+  return *Matrix_at(energy, i, j) +
+         window_min(Matrix_at(cost, i - 1, 0), Matrix_width(energy), j);
+}
+
+// Fills columns [lo, hi] of row i >= 1 of cost from row i - 1.
+static void cost_row(const Matrix* energy, Matrix* cost, int i, int lo, int hi) {
+  const int width = Matrix_width(energy);
+  const int* e = Matrix_at(energy, i, 0);
+  const int* prev = Matrix_at(cost, i - 1, 0);
+  int* out = Matrix_at(cost, i, 0);
+
+  // columns 1 .. width - 3 see all three neighbours above, so they take a
+  // branchless 3-way min the compiler can vectorize; the few columns at
+  // the edges use the general window
+  int start = std::max(lo, 1);
+  int stop = std::min(hi, width - 3);
+
+  int j = lo;
+  for (; j <= hi && j < start; j++) {
+    out[j] = e[j] + window_min(prev, width, j);
+  }
+  for (; j <= stop; j++) {
+    out[j] = e[j] + std::min(std::min(prev[j - 1], prev[j]), prev[j + 1]);
+  }
+  for (; j <= hi; j++) {
+    out[j] = e[j] + window_min(prev, width, j);
+  }
+}
+
+// Threads used by compute_vertical_cost_matrix, and the pool that
+// provides them (created on first use).
+static int processing_thread_count = 1;
+static ThreadPool* processing_pool = nullptr;
+
+// Narrowest column strip worth giving to a thread.
+static const int MIN_STRIP_WIDTH = 512;
+
+// Most rows computed between two synchronisations.
+static const int MAX_BLOCK_ROWS = 128;
+
+// Fills rows 1 .. height - 1 of cost in parallel. The columns are split
+// into one strip per task and the rows into blocks. For each block, every
+// task first computes the shrinking trapezoid of its strip that depends
+// only on the row above the block (row k of the block loses k columns at
+// each inner edge). Then one task per strip boundary fills the growing
+// triangle left between two trapezoids. Blocks are at most half a strip
+// tall, so the triangles never touch. Every cell is computed exactly as
+// in the serial loop, so the result does not depend on the thread count.
+static void cost_rows_parallel(const Matrix* energy, Matrix* cost,
+                               ThreadPool* pool, int tasks) {
+  // the tasks only capture a pointer to this, which std::function stores
+  // without allocating
+  struct Strip_Work {
+    const Matrix* energy;
+    Matrix* cost;
+    int width;
+    int tasks;
+    int top;
+    int rows;
+    // first column of strip s; strip tasks is the end of the matrix
+    int bound(int s) const {
+      return static_cast<int>(static_cast<long long>(width) * s / tasks);
+    }
+  } work = { energy, cost, Matrix_width(energy), tasks, 0, 0 };
+
+  const int height = Matrix_height(energy);
+  const int blockRows = std::min(MAX_BLOCK_ROWS, (work.width / tasks) / 2);
+  const Strip_Work* w = &work;
+
+  for (work.top = 1; work.top < height; work.top += blockRows) {
+    work.rows = std::min(blockRows, height - work.top);
+
+    ThreadPool_run(pool, tasks, [w](int s) {
+      const int a = w->bound(s);
+      const int b = w->bound(s + 1);
+      for (int k = 0; k < w->rows; k++) {
+        int lo = a == 0 ? 0 : a + k;
+        int hi = (b == w->width ? w->width : b - k) - 1;
+        cost_row(w->energy, w->cost, w->top + k, lo, hi);
+      }
+    });
+
+    ThreadPool_run(pool, tasks - 1, [w](int s) {
+      const int x = w->bound(s + 1);
+      for (int k = 1; k < w->rows; k++) {
+        cost_row(w->energy, w->cost, w->top + k, x - k, x + k - 1);
+      }
+    });
+  }
+}
+
+// REQUIRES: 0 < threads
+// MODIFIES: the thread count used by the processing functions
+// EFFECTS:  Sets how many threads compute_vertical_cost_matrix may use.
+//           Not safe to call while processing functions are running.
+void set_processing_threads(int threads) {
+  processing_thread_count = std::max(1, threads);
+  if (processing_pool &&
+      ThreadPool_size(processing_pool) != processing_thread_count) {
+    ThreadPool_destroy(processing_pool);
+    delete processing_pool;
+    processing_pool = nullptr;
+  }
+}
+
+// EFFECTS:  Returns the thread count set by set_processing_threads
+//           (1 by default).
+int processing_threads() {
+  return processing_thread_count;
+}
+
 // REQUIRES: energy points to a valid Matrix.
 //           cost points to a Matrix.
 //           energy and cost aren't pointing to the same Matrix
@@ -86,21 +528,31 @@ void compute_energy_matrix(const Image* img, Matrix* energy) {
 // EFFECTS:  cost serves as an "output parameter".
 //           The Matrix pointed to by cost is initialized to be the same
 //           size as the given energy Matrix, and then the cost matrix is
-//           computed and written into it.
+//           computed and written into it. Wide matrices are split over
+//           the threads set by set_processing_threads; the result is
+//           the same for any thread count.
 void compute_vertical_cost_matrix(const Matrix* energy, Matrix *cost) {
-  Matrix_init(cost, Matrix_width(energy), Matrix_height(energy));
+  PROFILE_SCOPE(PROFILE_COST, static_cast<long long>(sizeof(int)) *
+                               Matrix_width(energy) * Matrix_height(energy));
+  Matrix_reshape(cost, Matrix_width(energy), Matrix_height(energy));
 
   for (int i = 0; i < energy->width; i++) {
     *Matrix_at(cost, 0, i) = *Matrix_at(energy, 0, i);
   }
 
-  for (int i = 1; i < Matrix_height(energy); i++) {
-    for (int j = 0; j < Matrix_width(energy); j++) {
-      int left = std::max(0, j - 1);
-      int right = std::min(Matrix_width(energy) - 1, j + 2);
-  
-      *Matrix_at(cost, i, j) = *Matrix_at(energy, i, j) + Matrix_min_value_in_row(cost, i - 1, left, right);
+  const int tasks = std::min(processing_thread_count,
+                             Matrix_width(energy) / MIN_STRIP_WIDTH);
+  if (tasks >= 2) {
+    if (!processing_pool) {
+      processing_pool = new ThreadPool;
+      ThreadPool_init(processing_pool, processing_thread_count);
     }
+    cost_rows_parallel(energy, cost, processing_pool, tasks);
+    return;
+  }
+
+  for (int i = 1; i < Matrix_height(energy); i++) {
+    cost_row(energy, cost, i, 0, Matrix_width(energy) - 1);
   }
 }
 
@@ -114,7 +566,19 @@ void compute_vertical_cost_matrix(const Matrix* energy, Matrix *cost) {
 //           While determining the seam, if any pixels tie for lowest cost, the
 //           leftmost one (i.e. with the lowest column number) is used.
 vector<int> find_minimal_vertical_seam(const Matrix* cost) {
-  vector<int> seamCalc(Matrix_height(cost));
+  vector<int> seam;
+  find_minimal_vertical_seam(cost, &seam);
+  return seam;
+}
+
+// REQUIRES: cost points to a valid Matrix, seam points to a vector
+// MODIFIES: *seam
+// EFFECTS:  Same as find_minimal_vertical_seam, but stores the seam in
+//           *seam, reusing its memory.
+void find_minimal_vertical_seam(const Matrix* cost, vector<int>* seam) {
+  PROFILE_SCOPE(PROFILE_SEAM, 3LL * sizeof(int) * Matrix_height(cost));
+  vector<int> &seamCalc = *seam;
+  seamCalc.resize(Matrix_height(cost));
   seamCalc[Matrix_height(cost) - 1] = Matrix_column_of_min_value_in_row(cost, Matrix_height(cost) - 1, 0, Matrix_width(cost));
   
   for (int i = Matrix_height(cost) - 2; i >= 0; i--) {
@@ -124,8 +588,127 @@ vector<int> find_minimal_vertical_seam(const Matrix* cost) {
 
     seamCalc[i] = Matrix_column_of_min_value_in_row(cost, i, left, right + 1);
   }
+}
 
-  return seamCalc;
+// Step from column j to the column find_minimal_vertical_seam picks in
+// the row above, prev: the first minimum of prev[j - 1 .. j + 1], clipped
+// to the width. This window is not always the one the cost of column j
+// was computed from (see window_min), so it is found separately.
+static inline int step_above(const int* prev, int width, int j) {
+  int left = std::max(0, j - 1);
+  int right = std::min(width - 1, j + 1);
+
+  int best = left;
+  for (int k = left + 1; k <= right; k++) {
+    if (prev[k] < prev[best]) {
+      best = k;
+    }
+  }
+  return best - j;
+}
+
+// The steps DP of find_minimal_vertical_seam_by_steps for a width x
+// height energy matrix whose row i is energyRow(i).
+template <class Energy_Row>
+static void seam_by_steps(int width, int height, Energy_Row energyRow,
+                          Seam_Steps* steps, vector<int>* seam) {
+  Tracked_Vector<signed char> &step = steps->steps;
+  vector<int> &above = steps->above;
+  vector<int> &below = steps->below;
+  step.resize(static_cast<size_t>(width) * height);
+  above.resize(width);
+  below.resize(width);
+
+  {
+    PROFILE_SCOPE(PROFILE_COST, (sizeof(int) + 1LL) * width * height);
+    const int* first = energyRow(0);
+    std::copy(first, first + width, above.begin());
+
+    for (int i = 1; i < height; i++) {
+      const int* e = energyRow(i);
+      const int* prev = above.data();
+      int* out = below.data();
+      signed char* rowSteps = &step[static_cast<size_t>(i) * width];
+
+      // as in cost_row, only the few columns at the edges need the
+      // general windows
+      int j = 0;
+      for (; j < width && j < 1; j++) {
+        out[j] = e[j] + window_min(prev, width, j);
+        rowSteps[j] = static_cast<signed char>(step_above(prev, width, j));
+      }
+      if (j <= width - 3) {
+        step_compute_row(prev, e, out, rowSteps, j, width - 3);
+        j = width - 2;
+      }
+      for (; j < width; j++) {
+        out[j] = e[j] + window_min(prev, width, j);
+        rowSteps[j] = static_cast<signed char>(step_above(prev, width, j));
+      }
+      above.swap(below);
+    }
+  }
+
+  PROFILE_SCOPE(PROFILE_SEAM, static_cast<long long>(height));
+  vector<int> &columns = *seam;
+  columns.resize(height);
+  columns[height - 1] = static_cast<int>(
+      std::min_element(above.begin(), above.begin() + width) - above.begin());
+  for (int i = height - 1; i > 0; i--) {
+    columns[i - 1] = columns[i] + step[static_cast<size_t>(i) * width + columns[i]];
+  }
+}
+
+// REQUIRES: energy points to a valid Matrix
+//           steps points to a Seam_Steps, seam points to a vector
+// MODIFIES: *steps, *seam
+// EFFECTS:  Stores in *seam the seam find_minimal_vertical_seam finds in
+//           the cost matrix of energy, ties included, without keeping
+//           that matrix. The costs are computed one row at a time from
+//           the row above, and for every pixel the step (-1, 0 or +1) to
+//           the column the seam takes in the row above is recorded in one
+//           byte. The seam is then traced up from the cheapest pixel of
+//           the bottom row in O(height) time. Needs a quarter of the
+//           memory of the cost matrix.
+void find_minimal_vertical_seam_by_steps(const Matrix* energy,
+                                         Seam_Steps* steps,
+                                         vector<int>* seam) {
+  seam_by_steps(Matrix_width(energy), Matrix_height(energy),
+                [&](int i) { return Matrix_at(energy, i, 0); }, steps, seam);
+}
+
+// REQUIRES: energy points to a valid Compact_Matrix
+//           steps points to a Seam_Steps, seam points to a vector
+// MODIFIES: *steps, *seam
+// EFFECTS:  Same as widening energy and calling
+//           find_minimal_vertical_seam_by_steps, but only one row of
+//           energies is widened at a time, into steps->row. The costs are
+//           32-bit, so the seam is found even where 16-bit costs would
+//           saturate.
+void find_minimal_compact_seam_by_steps(const Compact_Matrix* energy,
+                                        Seam_Steps* steps,
+                                        vector<int>* seam) {
+  vector<int> &row = steps->row;
+  row.resize(energy->width);
+  seam_by_steps(energy->width, energy->height,
+                [&](int i) {
+                  const uint16_t* in = Compact_Matrix_row(energy, i);
+                  std::copy(in, in + energy->width, row.begin());
+                  return static_cast<const int*>(row.data());
+                }, steps, seam);
+}
+
+// REQUIRES: cost is the cost matrix of an energy matrix computed by
+//           compute_horizontal_energy_matrix
+// EFFECTS:  Returns the horizontal seam with the minimal cost, as a vector
+//           holding for each column of the image (left to right) the row
+//           of the pixel on the seam. The length of the returned vector is
+//           equal to Matrix_height(cost). Ties are broken the same way as
+//           find_minimal_vertical_seam on the rotated image.
+vector<int> find_minimal_horizontal_seam(const Matrix* cost) {
+  vector<int> seam = find_minimal_vertical_seam(cost);
+  std::reverse(seam.begin(), seam.end());
+  return seam;
 }
 
 
@@ -138,52 +721,566 @@ vector<int> find_minimal_vertical_seam(const Matrix* cost) {
 //           removed from row r will be the one with column equal to seam[r].
 //           The width of the image will be one less than before.
 void remove_vertical_seam(Image *img, const vector<int> &seam) {
-  Image temp;
-  Image_init(&temp, Image_width(img) - 1, Image_height(img));
+  PROFILE_SCOPE(PROFILE_REMOVE, Image_bytes(img));
+
+  // each row of each channel is compacted in place; the stride stays the
+  // same so nothing is allocated and only the tails of the rows move
+  const int width = Image_width(img);
 
-  for (int i = 0; i < Image_height(img); i++) {
-    for (int j = 0; j < seam[i]; j++) {
-      Image_set_pixel(&temp, i, j, Image_get_pixel(img, i, j));
+  for (int ch = 0; ch < Image_channels(img); ch++) {
+    for (int i = 0; i < Image_height(img); i++) {
+      unsigned char* row = Image_row(img, ch, i);
+      std::memmove(row + seam[i], row + seam[i] + 1, width - 1 - seam[i]);
     }
-    for (int j = seam[i] + 1; j < Image_width(img); j++) {
-      Image_set_pixel(&temp, i, j - 1, Image_get_pixel(img, i , j));
+  }
+
+  img->width--;
+}
+
+// Columns moved together by remove_horizontal_seam.
+static const int SEAM_CHUNK_COLUMNS = 64;
+
+// remove_horizontal_seam, with chunkTop and chunkBottom as scratch space.
+static void remove_row_seam(Image *img, const vector<int> &seam,
+                            vector<int> &chunkTop, vector<int> &chunkBottom) {
+  PROFILE_SCOPE(PROFILE_REMOVE, Image_bytes(img));
+
+  // every pixel at or below the seam moves up one row. A seam moves at
+  // most one row per column, so within a chunk of columns only a few rows
+  // need a per-pixel select; the rest of the chunk is either left alone
+  // or copied whole, and rows below the whole seam are copied whole
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  const int chunks = (width + SEAM_CHUNK_COLUMNS - 1) / SEAM_CHUNK_COLUMNS;
+
+  chunkTop.resize(chunks);
+  chunkBottom.resize(chunks);
+  for (int k = 0; k < chunks; k++) {
+    const int* first = &seam[k * SEAM_CHUNK_COLUMNS];
+    const int* last = first + std::min(SEAM_CHUNK_COLUMNS,
+                                       width - k * SEAM_CHUNK_COLUMNS);
+    chunkTop[k] = *std::min_element(first, last);
+    chunkBottom[k] = *std::max_element(first, last);
+  }
+  const int top = *std::min_element(chunkTop.begin(), chunkTop.end());
+  const int bottom = *std::max_element(chunkBottom.begin(), chunkBottom.end());
+
+  for (int ch = 0; ch < Image_channels(img); ch++) {
+    for (int r = top; r < height - 1; r++) {
+      unsigned char* row = Image_row(img, ch, r);
+      const unsigned char* next = Image_row(img, ch, r + 1);
+      if (r >= bottom) {
+        std::memcpy(row, next, width);
+        continue;
+      }
+
+      for (int k = 0; k < chunks; k++) {
+        if (r < chunkTop[k]) {
+          continue;
+        }
+        const int left = k * SEAM_CHUNK_COLUMNS;
+        const int right = std::min(width, left + SEAM_CHUNK_COLUMNS);
+        if (r >= chunkBottom[k]) {
+          std::memcpy(row + left, next + left, right - left);
+          continue;
+        }
+        for (int c = left; c < right; c++) {
+          row[c] = r >= seam[c] ? next[c] : row[c];
+        }
+      }
+    }
+  }
+
+  img->height--;
+}
+
+// REQUIRES: img points to a valid Image with height >= 2
+//           seam.size() == Image_width(img)
+//           each element x in seam satisfies 0 <= x < Image_height(img)
+// MODIFIES: *img
+// EFFECTS:  Removes the given horizontal seam from the Image. That is, one
+//           pixel will be removed from every column in the image. The
+//           pixel removed from column c will be the one with row equal to
+//           seam[c]. The height of the image will be one less than before.
+void remove_horizontal_seam(Image *img, const vector<int> &seam) {
+  vector<int> chunkTop;
+  vector<int> chunkBottom;
+  remove_row_seam(img, seam, chunkTop, chunkBottom);
+}
+
+// REQUIRES: view points to a valid Image_View with width >= 2
+//           seam.size() == Image_View_height(view)
+//           each element x in seam satisfies 0 <= x < Image_View_width(view)
+//           scratch points to a Seam_Removal
+// MODIFIES: *view->img, *scratch
+// EFFECTS:  Removes the given vertical seam of the view, which is a
+//           vertical or horizontal seam of the image depending on how the
+//           view is turned, in place. The view's width is one less than
+//           before.
+void remove_vertical_seam_view(Image_View* view, const vector<int> &seam,
+                               Seam_Removal* scratch) {
+  Image* img = view->img;
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  if (view->turns == 0) {
+    remove_vertical_seam(img, seam);
+    return;
+  }
+
+  // the seam in the image's own coordinates
+  vector<int> &mapped = scratch->seam;
+  mapped.resize(seam.size());
+  const int n = static_cast<int>(seam.size());
+  for (int k = 0; k < n; k++) {
+    switch (view->turns) {
+    case 1:
+      // row k of the view is image column width - 1 - k
+      mapped[width - 1 - k] = seam[k];
+      break;
+    case 2:
+      mapped[height - 1 - k] = width - 1 - seam[k];
+      break;
+    default:
+      // row k of the view is image column k, read bottom to top
+      mapped[k] = height - 1 - seam[k];
+      break;
+    }
+  }
+  if (view->turns == 2) {
+    remove_vertical_seam(img, mapped);
+  } else {
+    remove_row_seam(img, mapped, scratch->chunkTop, scratch->chunkBottom);
+  }
+}
+
+
+// Counts of the interior energy values, so the border value (the maximum
+// interior energy) can be kept up to date without rescanning the matrix.
+static void histogram_add(vector<int> &hist, int value, int &maxValue) {
+  if (value >= static_cast<int>(hist.size())) {
+    hist.resize(value + 1, 0);
+  }
+  hist[value]++;
+  if (value > maxValue) {
+    maxValue = value;
+  }
+}
+
+static void histogram_remove(vector<int> &hist, int value, int &maxValue) {
+  hist[value]--;
+  while (maxValue > 0 && hist[maxValue] == 0) {
+    maxValue--;
+  }
+}
+
+// Columns [lo, hi] of row i (in the coordinates before the seam is
+// removed) cover every pixel whose energy can change when seam is removed:
+// the removed pixel's horizontal neighbours and every pixel whose vertical
+// neighbours end up shifted by a different amount.
+static void seam_band(const vector<int> &seam, int i, int &lo, int &hi) {
+  lo = seam[i];
+  hi = seam[i];
+  if (i > 0) {
+    lo = std::min(lo, seam[i - 1]);
+    hi = std::max(hi, seam[i - 1]);
+  }
+  if (i + 1 < static_cast<int>(seam.size())) {
+    lo = std::min(lo, seam[i + 1]);
+    hi = std::max(hi, seam[i + 1]);
+  }
+  lo -= 1;
+}
+
+// Computes the energies of pixels lo..hi of a run through the image
+// planes (see Image_View_run): pixel j is at offset + j * step in each
+// plane. The pixels are interior ones, but the run may go down a column
+// or backwards, so they are computed one at a time with the same formula
+// as the energy kernels. Energy does not depend on which way the image is
+// turned, so this is the energy of the view as well.
+static void energy_run(const Image* img, long offset, long step, int lo,
+                       int hi, int* out) {
+  const long stride = img->stride;
+  const int channels = Image_channels(img);
+  const int weight = channels == 1 ? ENERGY_GRAY_WEIGHT : 1;
+  const unsigned char* plane[IMAGE_CHANNELS];
+  for (int ch = 0; ch < channels; ch++) {
+    plane[ch] = Image_row(img, ch, 0) + offset;
+  }
+
+  for (int j = lo; j <= hi; j++) {
+    int vertical = 0;
+    int horizontal = 0;
+    for (int ch = 0; ch < channels; ch++) {
+      const unsigned char* p = plane[ch] + j * step;
+      int dv = p[stride] - p[-stride];
+      int dh = p[1] - p[-1];
+      vertical += dv * dv;
+      horizontal += dh * dh;
+    }
+    out[j] = weight * vertical / 100 + weight * horizontal / 100;
+  }
+}
+
+// Recomputes the energies in columns [lo, hi] of row i of a matrix laid
+// out by compute_horizontal_energy_matrix: image rows lo..hi of image
+// column Image_width(img) - 1 - i.
+static void energy_column(const Image* img, int i, int lo, int hi, int* out) {
+  energy_run(img, Image_width(img) - 1 - i, img->stride, lo, hi, out);
+}
+
+// REQUIRES: view points to a valid Image_View
+//           1 <= row && row < Image_View_height(view) - 1
+//           1 <= lo && hi < Image_View_width(view) - 1
+// MODIFIES: out[lo..hi]
+// EFFECTS:  Sets out[j] to the energy of pixel (row, j) of the view for
+//           each j in [lo, hi]. Upright views use the vector kernels.
+void compute_energy_row_view(const Image_View* view, int row, int lo, int hi,
+                             int* out) {
+  if (view->turns == 0) {
+    energy_row(view->img, row, lo, hi, out);
+    return;
+  }
+  long offset;
+  long step;
+  Image_View_run(view, row, &offset, &step);
+  energy_run(view->img, offset, step, lo, hi, out);
+}
+
+// Removes the seam carve_seams found, carver->seam (or carver->imageSeam
+// for a horizontal one), from img.
+static void remove_carved_seam(SeamCarver* carver, Image *img,
+                               bool horizontal) {
+  if (horizontal) {
+    remove_row_seam(img, carver->imageSeam, carver->chunkTop,
+                    carver->chunkBottom);
+  } else {
+    remove_vertical_seam(img, carver->seam);
+  }
+}
+
+// The rest of carve_seams in 16-bit or steps precision, once
+// carver->compactEnergy holds the energies of source (img or its luma)
+// and, if fits is true, carver->compactCost their unsaturated costs. The
+// energies are kept up to date the same way. In 16-bit precision the
+// cost matrix is recomputed for every seam; a seam whose costs saturate
+// is found with the steps DP on the 16-bit energies instead, so no
+// 32-bit matrix is ever made. In steps precision every seam is found
+// that way and there is no cost matrix at all.
+static void carve_compact(SeamCarver* carver, Image *img, Image *source,
+                          int runs, bool horizontal, bool fits) {
+  Compact_Matrix &energy = carver->compactEnergy;
+  Compact_Matrix &cost = carver->compactCost;
+  vector<int> &opSeam = carver->seam;
+  vector<int> &imageSeam = carver->imageSeam;
+
+  const int height = energy.height;
+  vector<int> &bandLo = carver->bandLo;
+  vector<int> &bandHi = carver->bandHi;
+  bandLo.resize(height);
+  bandHi.resize(height);
+  vector<int> &updated = carver->scratch;
+  updated.resize(energy.width);
+
+  vector<int> &hist = carver->histogram;
+  hist.assign(ENERGY_MAX + 1, 0);
+  int maxEnergy = 0;
+  for (int i = 1; i < height - 1; i++) {
+    const uint16_t* row = Compact_Matrix_row(&energy, i);
+    for (int j = 1; j < energy.width - 1; j++) {
+      histogram_add(hist, row[j], maxEnergy);
     }
   }
 
-  *img = temp;
+  for (int run = 0; run < runs; run++) {
+    if (fits) {
+      find_minimal_compact_seam(&cost, &opSeam);
+    } else {
+      find_minimal_compact_seam_by_steps(&energy, &carver->steps, &opSeam);
+    }
+    if (horizontal) {
+      std::reverse_copy(opSeam.begin(), opSeam.end(), imageSeam.begin());
+    }
+    if (run == runs - 1) {
+      remove_carved_seam(carver, img, horizontal);
+      break;
+    }
+
+    const int width = energy.width;
+    for (int i = 0; i < height; i++) {
+      seam_band(opSeam, i, bandLo[i], bandHi[i]);
+    }
+    for (int i = 1; i < height - 1; i++) {
+      const uint16_t* row = Compact_Matrix_row(&energy, i);
+      int hi = std::min(width - 2, bandHi[i] + 1);
+      for (int j = std::max(1, bandLo[i]); j <= hi; j++) {
+        histogram_remove(hist, row[j], maxEnergy);
+      }
+    }
+
+    remove_carved_seam(carver, img, horizontal);
+    if (source != img) {
+      remove_carved_seam(carver, source, horizontal);
+    }
+    {
+      PROFILE_SCOPE(PROFILE_REMOVE, 2LL * sizeof(uint16_t) * width * height);
+      Compact_Matrix_remove_vertical_seam(&energy, opSeam);
+    }
+
+    const int newWidthNow = width - 1;
+    {
+      PROFILE_SCOPE(PROFILE_ENERGY_UPDATE, 0);
+      long long count = 0;
+      for (int i = 1; i < height - 1; i++) {
+        int lo = std::max(1, bandLo[i]);
+        int hi = std::min(newWidthNow - 2, bandHi[i]);
+        if (horizontal) {
+          energy_column(source, i, lo, hi, updated.data());
+        } else {
+          energy_row(source, i, lo, hi, updated.data());
+        }
+        uint16_t* row = Compact_Matrix_row(&energy, i);
+        for (int j = lo; j <= hi; j++) {
+          row[j] = static_cast<uint16_t>(updated[j]);
+          histogram_add(hist, updated[j], maxEnergy);
+        }
+        count += std::max(0, hi - lo + 1);
+      }
+      Compact_Matrix_fill_border(&energy, static_cast<uint16_t>(maxEnergy));
+      PROFILE_BYTES(Image_channels(source) * count);
+      (void)count;
+    }
+
+    fits = carver->precision == CARVE_PRECISION_16 &&
+           compute_compact_cost_matrix(&energy, &cost);
+  }
 }
 
+// Removes runs seams from img, vertical ones if horizontal is false and
+// horizontal ones otherwise. The energy and cost matrices are kept in the
+// layout where seams are vertical (see compute_horizontal_energy_matrix),
+// so everything but reading and removing pixels is shared between the
+// two directions. If order is not null, it must be a matrix of the image's
+// size in that layout; order(i, j) is set to the run that removed the
+// pixel in row i, column j, or to runs for pixels that are kept; this is
+// always done in 32-bit precision. With ENERGY_SOURCE_LUMA, the energies
+// of a color image are computed from carver->luma, which loses the same
+// seams as img.
+// All other memory comes from carver, so once its buffers are large
+// enough nothing is allocated.
+static void carve_seams(SeamCarver* carver, Image *img, int runs,
+                        bool horizontal, Matrix* order) {
+  if (runs <= 0) {
+    return;
+  }
+
+  Matrix &opEnergy = carver->energy;
+  Matrix &opCost = carver->cost;
+  vector<int> &opSeam = carver->seam;
+  vector<int> &imageSeam = carver->imageSeam;
+
+  Image* source = img;
+  if (carver->source == ENERGY_SOURCE_LUMA && Image_channels(img) > 1) {
+    Image_luma(img, &carver->luma);
+    source = &carver->luma;
+  }
+
+  if (horizontal) {
+    imageSeam.resize(Image_width(img));
+  }
+
+  // the 16-bit and steps paths never make a 32-bit matrix
+  if (carver->precision != CARVE_PRECISION_32 && !order) {
+    if (horizontal) {
+      sideways_energy(source, &carver->compactEnergy, carver->scratch, true);
+    } else {
+      compact_energy(source, &carver->compactEnergy, carver->scratch);
+    }
+    const bool fits = carver->precision == CARVE_PRECISION_16 &&
+                      compute_compact_cost_matrix(&carver->compactEnergy,
+                                                  &carver->compactCost);
+    carve_compact(carver, img, source, runs, horizontal, fits);
+    return;
+  }
+
+  if (horizontal) {
+    horizontal_energy(source, &opEnergy, carver->scratch);
+  } else {
+    compute_energy_matrix(source, &opEnergy);
+  }
+  compute_vertical_cost_matrix(&opEnergy, &opCost);
+
+  const int height = Matrix_height(&opEnergy);
+  vector<int> &bandLo = carver->bandLo;
+  vector<int> &bandHi = carver->bandHi;
+  bandLo.resize(height);
+  bandHi.resize(height);
+
+  // origin(i, j) is the original column of what is now column j of row i
+  Matrix origin;
+  if (order) {
+    Matrix_init(&origin, Matrix_width(&opEnergy), height);
+    for (int i = 0; i < height; i++) {
+      for (int j = 0; j < Matrix_width(&opEnergy); j++) {
+        *Matrix_at(&origin, i, j) = j;
+      }
+    }
+    Matrix_fill(order, runs);
+  }
+
+  // sized for every possible energy so it never has to grow
+  vector<int> &hist = carver->histogram;
+  hist.assign(ENERGY_MAX + 1, 0);
+  int maxEnergy = 0;
+  for (int i = 1; i < height - 1; i++) {
+    for (int j = 1; j < Matrix_width(&opEnergy) - 1; j++) {
+      histogram_add(hist, *Matrix_at(&opEnergy, i, j), maxEnergy);
+    }
+  }
+
+  for (int run = 0; run < runs; run++) {
+    find_minimal_vertical_seam(&opCost, &opSeam);
+    if (horizontal) {
+      std::reverse_copy(opSeam.begin(), opSeam.end(), imageSeam.begin());
+    }
+    if (order) {
+      for (int i = 0; i < height; i++) {
+        *Matrix_at(order, i, *Matrix_at(&origin, i, opSeam[i])) = run;
+      }
+      Matrix_remove_vertical_seam(&origin, opSeam);
+    }
+    if (run == runs - 1) {
+      remove_carved_seam(carver, img, horizontal);
+      break;
+    }
+
+    const int width = Matrix_width(&opEnergy);
+    const int oldBorder = maxEnergy;
+    for (int i = 0; i < height; i++) {
+      seam_band(opSeam, i, bandLo[i], bandHi[i]);
+    }
+
+    // forget the interior energies that are about to be removed or
+    // recomputed (this includes pixels that become part of the border)
+    for (int i = 1; i < height - 1; i++) {
+      int hi = std::min(width - 2, bandHi[i] + 1);
+      for (int j = std::max(1, bandLo[i]); j <= hi; j++) {
+        histogram_remove(hist, *Matrix_at(&opEnergy, i, j), maxEnergy);
+      }
+    }
+
+    remove_carved_seam(carver, img, horizontal);
+    if (source != img) {
+      remove_carved_seam(carver, source, horizontal);
+    }
+    {
+      PROFILE_SCOPE(PROFILE_REMOVE, 2LL * sizeof(int) * width * height);
+      Matrix_remove_vertical_seam(&opEnergy, opSeam);
+      Matrix_remove_vertical_seam(&opCost, opSeam);
+    }
+
+    const int newWidthNow = width - 1;
+    {
+      PROFILE_SCOPE(PROFILE_ENERGY_UPDATE, 0);
+      long long updated = 0;
+      for (int i = 1; i < height - 1; i++) {
+        int lo = std::max(1, bandLo[i]);
+        int hi = std::min(newWidthNow - 2, bandHi[i]);
+        int* row = Matrix_at(&opEnergy, i, 0);
+        if (horizontal) {
+          energy_column(source, i, lo, hi, row);
+        } else {
+          energy_row(source, i, lo, hi, row);
+        }
+        for (int j = lo; j <= hi; j++) {
+          histogram_add(hist, row[j], maxEnergy);
+        }
+        updated += std::max(0, hi - lo + 1);
+      }
+      Matrix_fill_border(&opEnergy, maxEnergy);
+      PROFILE_BYTES(Image_channels(source) * updated);
+      (void)updated;
+    }
+
+    // a new border value changes every border cell, including all of the
+    // first row, so nothing is saved by updating incrementally
+    if (maxEnergy != oldBorder) {
+      compute_vertical_cost_matrix(&opEnergy, &opCost);
+      continue;
+    }
+
+    // the first row of cost is the (unchanged) border; below it only the
+    // band and the cone under cells whose cost actually changed need work
+    PROFILE_SCOPE(PROFILE_COST_UPDATE, 0);
+    long long visited = 0;
+    int changedLo = 0;
+    int changedHi = -1;
+    for (int i = 1; i < height; i++) {
+      int lo = std::max(0, bandLo[i]);
+      int hi = std::min(newWidthNow - 1, bandHi[i]);
+      if (changedLo <= changedHi) {
+        lo = std::min(lo, std::max(0, changedLo - 1));
+        hi = std::max(hi, std::min(newWidthNow - 1, changedHi + 1));
+      }
+      visited += std::max(0, hi - lo + 1);
+
+      changedLo = newWidthNow;
+      changedHi = -1;
+      for (int j = lo; j <= hi; j++) {
+        int c = cost_at(&opEnergy, &opCost, i, j);
+        int* cell = Matrix_at(&opCost, i, j);
+        if (*cell != c) {
+          *cell = c;
+          changedLo = std::min(changedLo, j);
+          changedHi = j;
+        }
+      }
+    }
+    PROFILE_BYTES(static_cast<long long>(sizeof(int)) * visited);
+    (void)visited;
+  }
+}
 
 // REQUIRES: img points to a valid Image
 //           0 < newWidth && newWidth <= Image_width(img)
 // MODIFIES: *img
 // EFFECTS:  Reduces the width of the given Image to be newWidth by using
 //           the seam carving algorithm.
+//           The energy and cost matrices are kept between seams and only
+//           the region affected by each removed seam is recomputed. The
+//           result is identical to recomputing both matrices for every
+//           seam.
 void seam_carve_width(Image *img, int newWidth) {
-  int runs = Image_width(img) - newWidth;
-
-  Matrix opEnergy;
-  Matrix opCost;
-  vector<int> opSeam;
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  SeamCarver carver;
+  carve_seams(&carver, img, Image_width(img) - newWidth, false, nullptr);
+}
 
-  for (int i = 0; i < runs; i++) {
-    compute_energy_matrix(img, &opEnergy);
-    compute_vertical_cost_matrix(&opEnergy, &opCost);
-    opSeam = find_minimal_vertical_seam(&opCost);
-    remove_vertical_seam(img, opSeam);
-  }
+// REQUIRES: img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           order points to a Matrix
+// MODIFIES: *img, *order
+// EFFECTS:  Same as seam_carve_width, and also initializes *order to the
+//           size of the original image, with the number of the seam that
+//           removed each pixel (the first seam is 0), or
+//           Image_width(img) - newWidth for pixels that are kept.
+void seam_carve_width_order(Image *img, int newWidth, Matrix* order) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  Matrix_init(order, Image_width(img), Image_height(img));
+  SeamCarver carver;
+  carve_seams(&carver, img, Image_width(img) - newWidth, false, order);
 }
 
 // REQUIRES: img points to a valid Image
 //           0 < newHeight && newHeight <= Image_height(img)
 // MODIFIES: *img
-// EFFECTS:  Reduces the height of the given Image to be newHeight.
+// EFFECTS:  Reduces the height of the given Image to be newHeight by
+//           removing horizontal seams. The image is carved in place, never
+//           rotated, and the result is the same as rotating it left,
+//           reducing its width and rotating it back.
 void seam_carve_height(Image *img, int newHeight) {
-  rotate_left(img);
-
-  seam_carve_width(img, newHeight);
-
-  rotate_right(img);
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  SeamCarver carver;
+  carve_seams(&carver, img, Image_height(img) - newHeight, true, nullptr);
 }
 
 // REQUIRES: img points to a valid Image
@@ -193,13 +1290,71 @@ void seam_carve_height(Image *img, int newHeight) {
 // EFFECTS:  Reduces the width and height of the given Image to be newWidth
 //           and newHeight, respectively.
 void seam_carve(Image *img, int newWidth, int newHeight) {
-  seam_carve_width(img, newWidth);
+  SeamCarver carver;
+  SeamCarver_carve(&carver, img, newWidth, newHeight);
+}
 
-  rotate_left(img);
+// REQUIRES: carver points to a SeamCarver, img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Same as seam_carve_width, using the buffers, precision and
+//           energy source of *carver.
+void SeamCarver_carve_width(SeamCarver* carver, Image *img, int newWidth) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  carve_seams(carver, img, Image_width(img) - newWidth, false, nullptr);
+}
 
-  seam_carve_width(img, newHeight);
+// REQUIRES: carver points to a SeamCarver, img points to a valid Image
+//           0 < newHeight && newHeight <= Image_height(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Same as seam_carve_height, using the buffers, precision and
+//           energy source of *carver.
+void SeamCarver_carve_height(SeamCarver* carver, Image *img, int newHeight) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  carve_seams(carver, img, Image_height(img) - newHeight, true, nullptr);
+}
 
-  rotate_right(img);
+// REQUIRES: carver points to a SeamCarver, img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           0 < newHeight && newHeight <= Image_height(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Same as seam_carve, using the buffers, precision and
+//           energy source of *carver.
+void SeamCarver_carve(SeamCarver* carver, Image *img, int newWidth,
+                      int newHeight) {
+  SeamCarver_carve_width(carver, img, newWidth);
+  SeamCarver_carve_height(carver, img, newHeight);
+}
+
+// REQUIRES: carver points to a SeamCarver, view points to a valid
+//           Image_View
+//           0 < newWidth && newWidth <= Image_View_width(view)
+// MODIFIES: *carver, *view->img
+// EFFECTS:  Reduces the width of the view to newWidth, with the same
+//           result as materializing it, calling SeamCarver_carve_width and
+//           writing the copy back. An upright view is carved in place, and
+//           so is one turned to the left, which is SeamCarver_carve_height.
+//           The other two turns would search their seams from the opposite
+//           side of the image, which the in-place search cannot do with
+//           the same ties, so they are materialized and written back.
+void SeamCarver_carve_width_view(SeamCarver* carver, Image_View* view,
+                                 int newWidth) {
+  Image* img = view->img;
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  const int runs = Image_View_width(view) - newWidth;
+  if (view->turns < 2) {
+    carve_seams(carver, img, runs, view->turns == 1, nullptr);
+    return;
+  }
+
+  Image upright;
+  materialize_view(view, &upright);
+  carve_seams(carver, &upright, runs, false, nullptr);
+  // turning the carved copy back the other way gives the image again
+  Image_View back;
+  Image_View_init(&back, &upright);
+  back.turns = 4 - view->turns;
+  materialize_view(&back, img);
 }
 
 
@@ -214,6 +1369,8 @@ void seam_carve(Image *img, int newWidth, int newHeight) {
 //           The returned square will always be at least 1x1 and will
 //           not exceed the bounds of src.
 void crop_square_centered_at_max_energy(const Image* src, Image* dst) {
+  PROFILE_SCOPE(PROFILE_CROP, Image_bytes(src));
+
   // 1) compute energy
   Matrix energy;
   compute_energy_matrix(src, &energy);
@@ -247,33 +1404,63 @@ void crop_square_centered_at_max_energy(const Image* src, Image* dst) {
     }
   }
 
-  // guard against any mismatch between energy size and image size
-  if (maxR < 0) maxR = 0;
-  if (maxC < 0) maxC = 0;
-  if (maxR >= srcH) maxR = srcH - 1;
-  if (maxC >= srcW) maxC = srcW - 1;
-
-  // clamp to image
-  int target = 512;                     
-  int side = std::min(target, std::min(srcW, srcH));
-
-  // 4) center around (maxR, maxC) then clamp inside image
-  int half = side / 2;                  
-  int top  = maxR - half;
-  int left = maxC - half;
-
-  // clamp to keep the window fully inside the image
-  if (top < 0) top = 0;
-  if (left < 0) left = 0;
-  if (top + side > srcH) top = srcH - side;
-  if (left + side > srcW) left = srcW - side;
+  int top;
+  int left;
+  int side;
+  crop_square_around(srcW, srcH, maxR, maxC, &top, &left, &side);
 
   // copy pixels
-  Image_init(dst, side, side);
-  for (int r = 0; r < side; ++r) {
-    for (int c = 0; c < side; ++c) {
-      Image_set_pixel(dst, r, c, Image_get_pixel(src, top + r, left + c));
+  Image_init(dst, side, side, Image_channels(src));
+  for (int ch = 0; ch < Image_channels(src); ++ch) {
+    for (int r = 0; r < side; ++r) {
+      std::memcpy(Image_row(dst, ch, r), Image_row(src, ch, top + r) + left, side);
     }
   }
 }
 
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           that SeamCarver_carve with a new SeamCarver of the given
+//           precision and energy source holds at once while carving a
+//           width x height image with the given channels, not counting
+//           the image itself.
+long long SeamCarver_memory(int width, int height, int channels,
+                            Carve_Precision precision, Energy_Source source) {
+  // 32 bits: the energy and cost matrices; 16 bits: the compact ones and
+  // the steps of a saturated seam; steps: the compact energies and steps
+  long long perPixel = 0;
+  switch (precision) {
+  case CARVE_PRECISION_32: perPixel = 2 * sizeof(int); break;
+  case CARVE_PRECISION_16: perPixel = 2 * sizeof(uint16_t) + sizeof(signed char); break;
+  default: perPixel = sizeof(uint16_t) + sizeof(signed char); break;
+  }
+  if (source == ENERGY_SOURCE_LUMA && channels > 1) {
+    perPixel += 1;
+  }
+  // the matrices are laid out sideways for the height, with as many cells
+  // as upright, so the estimate is the same for both directions
+  return perPixel * width * height;
+}
+
+// REQUIRES: carver points to a SeamCarver
+// EFFECTS:  Returns the tracked memory (see memory.hpp), in bytes, that
+//           the buffers of *carver hold, kept for the next image.
+long long SeamCarver_held_memory(const SeamCarver* carver) {
+  return static_cast<long long>(carver->luma.data.capacity()) +
+         sizeof(int) * (carver->energy.data.capacity() + carver->cost.data.capacity()) +
+         sizeof(uint16_t) * (carver->compactEnergy.data.capacity() +
+                             carver->compactCost.data.capacity()) +
+         sizeof(signed char) * carver->steps.steps.capacity();
+}
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory, in bytes, that
+//           crop_square_centered_at_max_energy holds at once for a
+//           width x height source with the given channels, output
+//           included and the source not.
+long long crop_square_centered_at_max_energy_memory(int width, int height,
+                                                    int channels) {
+  const long long side = std::min(CROP_SQUARE_SIDE, std::min(width, height));
+  return static_cast<long long>(sizeof(int)) * width * height +
+         side * side * channels;
+}
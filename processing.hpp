@@ -1,19 +1,102 @@
 #ifndef PROCESSING_HPP
 #define PROCESSING_HPP
 
+#include <vector>
 #include "Matrix.hpp"
 #include "Image.hpp"
+#include "compact.hpp"
+#include "image_view.hpp"
+
+// Integer width of the energy and cost matrices a SeamCarver works with.
+// CARVE_PRECISION_32 keeps 32-bit matrices and updates the cost of only
+// the region each seam affects. CARVE_PRECISION_16 keeps 16-bit matrices
+// (see compact.hpp) and recomputes the whole cost matrix for every seam
+// with twice as many vector lanes and half the memory traffic; a seam
+// whose costs saturate is found with the steps DP instead. It needs half
+// the memory. CARVE_PRECISION_STEPS keeps only the 16-bit energies and
+// finds every seam with the steps DP
+// (find_minimal_compact_seam_by_steps), which needs the least memory and
+// is the slowest. All of them find the same seams.
+enum Carve_Precision {
+  CARVE_PRECISION_32,
+  CARVE_PRECISION_16,
+  CARVE_PRECISION_STEPS
+};
+
+// What the energies of a color image are computed from when carving.
+// ENERGY_SOURCE_LUMA computes them from a gray copy of the image's luma
+// (see Image_luma), which is carved along with the image: each energy
+// then reads one channel instead of three, and seams follow changes in
+// brightness but not in hue. Grayscale images are the same either way.
+enum Energy_Source {
+  ENERGY_SOURCE_COLOR,
+  ENERGY_SOURCE_LUMA
+};
+
+// Scratch space for find_minimal_vertical_seam_by_steps: one step per
+// pixel, two rows of costs and a row of widened 16-bit energies. Kept
+// between calls so that, once grown, finding a seam allocates nothing.
+struct Seam_Steps {
+  Tracked_Vector<signed char> steps;
+  std::vector<int> above;
+  std::vector<int> below;
+  std::vector<int> row;
+};
+
+// Scratch space for remove_vertical_seam_view: the seam in the image's
+// own coordinates and the chunk bounds of a horizontal seam. Kept between
+// calls so that, once grown, removing a seam allocates nothing.
+struct Seam_Removal {
+  std::vector<int> seam;
+  std::vector<int> chunkTop;
+  std::vector<int> chunkBottom;
+};
+
+// Buffers used while carving seams: the energy and cost matrices, the
+// current seam and scratch space. They are kept between seams, and can
+// be kept between images, so that once they have grown to the size of
+// the images being carved, carving allocates no memory.
+// A default-constructed SeamCarver is ready to use, with 32-bit precision
+// and energies computed from color.
+struct SeamCarver {
+  Carve_Precision precision = CARVE_PRECISION_32;
+  Energy_Source source = ENERGY_SOURCE_COLOR;
+  Image luma;
+  Matrix energy;
+  Matrix cost;
+  Compact_Matrix compactEnergy;
+  Compact_Matrix compactCost;
+  Seam_Steps steps;
+  std::vector<int> seam;
+  std::vector<int> imageSeam;
+  std::vector<int> bandLo;
+  std::vector<int> bandHi;
+  std::vector<int> histogram;
+  std::vector<int> scratch;
+  std::vector<int> chunkTop;
+  std::vector<int> chunkBottom;
+};
 
 // REQUIRES: img points to a valid Image
 // MODIFIES: *img
 // EFFECTS:  The image is rotated 90 degrees to the left (counterclockwise).
+//           Square images are rotated in place.
 void rotate_left(Image* img);
 
 // REQUIRES: img points to a valid Image.
 // MODIFIES: *img
 // EFFECTS:  The image is rotated 90 degrees to the right (clockwise).
+//           Square images are rotated in place.
 void rotate_right(Image* img);
 
+// REQUIRES: view points to a valid Image_View, dst points to an Image
+//           dst is not view->img
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to an upright copy of what the view shows,
+//           with the same tiled loops as rotate_left and rotate_right.
+//           This is the only view function that copies the image.
+void materialize_view(const Image_View* view, Image* dst);
+
 // REQUIRES: img points to a valid Image.
 //           energy points to a Matrix.
 // MODIFIES: *energy
@@ -23,6 +106,33 @@ void rotate_right(Image* img);
 //           image is computed and written into it.
 void compute_energy_matrix(const Image* img, Matrix* energy);
 
+// REQUIRES: img points to a valid Image.
+//           energy points to a Matrix.
+// MODIFIES: *energy
+// EFFECTS:  Like compute_energy_matrix, but lays the energies out for
+//           horizontal seams: row i of *energy holds image column
+//           Image_width(img) - 1 - i, top to bottom. This is the energy
+//           matrix of the image rotated left, so a horizontal seam of the
+//           image is a vertical seam of *energy. The image itself is read
+//           in place.
+void compute_horizontal_energy_matrix(const Image* img, Matrix* energy);
+
+// REQUIRES: view points to a valid Image_View, energy points to a Matrix
+// MODIFIES: *energy
+// EFFECTS:  Same as materializing the view and calling
+//           compute_energy_matrix on the copy, but reads the image in
+//           place, row by row, whichever way the view is turned.
+void compute_energy_matrix_view(const Image_View* view, Matrix* energy);
+
+// REQUIRES: view points to a valid Image_View
+//           1 <= row && row < Image_View_height(view) - 1
+//           1 <= lo && hi < Image_View_width(view) - 1
+// MODIFIES: out[lo..hi]
+// EFFECTS:  Sets out[j] to the energy of pixel (row, j) of the view for
+//           each j in [lo, hi]. Upright views use the vector kernels.
+void compute_energy_row_view(const Image_View* view, int row, int lo, int hi,
+                             int* out);
+
 // REQUIRES: energy points to a valid Matrix.
 //           cost points to a Matrix.
 //           energy and cost aren't pointing to the same Matrix
@@ -30,9 +140,21 @@ void compute_energy_matrix(const Image* img, Matrix* energy);
 // EFFECTS:  cost serves as an "output parameter".
 //           The Matrix pointed to by cost is initialized to be the same
 //           size as the given energy Matrix, and then the cost matrix is
-//           computed and written into it.
+//           computed and written into it. Wide matrices are split over
+//           the threads set by set_processing_threads; the result is
+//           the same for any thread count.
 void compute_vertical_cost_matrix(const Matrix* energy, Matrix *cost);
 
+// REQUIRES: 0 < threads
+// MODIFIES: the thread count used by the processing functions
+// EFFECTS:  Sets how many threads compute_vertical_cost_matrix may use.
+//           Not safe to call while processing functions are running.
+void set_processing_threads(int threads);
+
+// EFFECTS:  Returns the thread count set by set_processing_threads
+//           (1 by default).
+int processing_threads();
+
 // REQUIRES: cost points to a valid Matrix
 // EFFECTS:  Returns the vertical seam with the minimal cost according to the given
 //           cost matrix, represented as a vector filled with the column numbers for
@@ -43,6 +165,48 @@ void compute_vertical_cost_matrix(const Matrix* energy, Matrix *cost);
 //           leftmost one (i.e. with the lowest column number) is used.
 std::vector<int> find_minimal_vertical_seam(const Matrix* cost);
 
+// REQUIRES: cost points to a valid Matrix, seam points to a vector
+// MODIFIES: *seam
+// EFFECTS:  Same as find_minimal_vertical_seam, but stores the seam in
+//           *seam, reusing its memory.
+void find_minimal_vertical_seam(const Matrix* cost, std::vector<int>* seam);
+
+// REQUIRES: energy points to a valid Matrix
+//           steps points to a Seam_Steps, seam points to a vector
+// MODIFIES: *steps, *seam
+// EFFECTS:  Stores in *seam the seam find_minimal_vertical_seam finds in
+//           the cost matrix of energy, ties included, without keeping
+//           that matrix. The costs are computed one row at a time from
+//           the row above, and for every pixel the step (-1, 0 or +1) to
+//           the column the seam takes in the row above is recorded in one
+//           byte. The seam is then traced up from the cheapest pixel of
+//           the bottom row in O(height) time. Needs a quarter of the
+//           memory of the cost matrix.
+void find_minimal_vertical_seam_by_steps(const Matrix* energy,
+                                         Seam_Steps* steps,
+                                         std::vector<int>* seam);
+
+// REQUIRES: energy points to a valid Compact_Matrix
+//           steps points to a Seam_Steps, seam points to a vector
+// MODIFIES: *steps, *seam
+// EFFECTS:  Same as widening energy and calling
+//           find_minimal_vertical_seam_by_steps, but only one row of
+//           energies is widened at a time, into steps->row. The costs are
+//           32-bit, so the seam is found even where 16-bit costs would
+//           saturate.
+void find_minimal_compact_seam_by_steps(const Compact_Matrix* energy,
+                                        Seam_Steps* steps,
+                                        std::vector<int>* seam);
+
+// REQUIRES: cost is the cost matrix of an energy matrix computed by
+//           compute_horizontal_energy_matrix
+// EFFECTS:  Returns the horizontal seam with the minimal cost, as a vector
+//           holding for each column of the image (left to right) the row
+//           of the pixel on the seam. The length of the returned vector is
+//           equal to Matrix_height(cost). Ties are broken the same way as
+//           find_minimal_vertical_seam on the rotated image.
+std::vector<int> find_minimal_horizontal_seam(const Matrix* cost);
+
 // REQUIRES: img points to a valid Image with width >= 2
 //           seam.size() == Image_height(img)
 //           each element x in seam satisfies 0 <= x < Image_width(img)
@@ -53,19 +217,95 @@ std::vector<int> find_minimal_vertical_seam(const Matrix* cost);
 //           The width of the image will be one less than before.
 void remove_vertical_seam(Image *img, const std::vector<int> &seam);
 
+// REQUIRES: img points to a valid Image with height >= 2
+//           seam.size() == Image_width(img)
+//           each element x in seam satisfies 0 <= x < Image_height(img)
+// MODIFIES: *img
+// EFFECTS:  Removes the given horizontal seam from the Image. That is, one
+//           pixel will be removed from every column in the image. The
+//           pixel removed from column c will be the one with row equal to
+//           seam[c]. The height of the image will be one less than before.
+void remove_horizontal_seam(Image *img, const std::vector<int> &seam);
+
+// REQUIRES: view points to a valid Image_View with width >= 2
+//           seam.size() == Image_View_height(view)
+//           each element x in seam satisfies 0 <= x < Image_View_width(view)
+//           scratch points to a Seam_Removal
+// MODIFIES: *view->img, *scratch
+// EFFECTS:  Removes the given vertical seam of the view, which is a
+//           vertical or horizontal seam of the image depending on how the
+//           view is turned, in place. The view's width is one less than
+//           before.
+void remove_vertical_seam_view(Image_View* view, const std::vector<int> &seam,
+                               Seam_Removal* scratch);
+
 // REQUIRES: img points to a valid Image
 //           0 < newWidth && newWidth <= Image_width(img)
 // MODIFIES: *img
 // EFFECTS:  Reduces the width of the given Image to be newWidth by using
 //           the seam carving algorithm.
+//           The energy and cost matrices are kept between seams and only
+//           the region affected by each removed seam is recomputed. The
+//           result is identical to recomputing both matrices for every
+//           seam.
 void seam_carve_width(Image *img, int newWidth);
 
+// REQUIRES: img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           order points to a Matrix
+// MODIFIES: *img, *order
+// EFFECTS:  Same as seam_carve_width, and also initializes *order to the
+//           size of the original image, with the number of the seam that
+//           removed each pixel (the first seam is 0), or
+//           Image_width(img) - newWidth for pixels that are kept.
+void seam_carve_width_order(Image *img, int newWidth, Matrix* order);
+
 // REQUIRES: img points to a valid Image
 //           0 < newHeight && newHeight <= Image_height(img)
 // MODIFIES: *img
-// EFFECTS:  Reduces the height of the given Image to be newHeight.
+// EFFECTS:  Reduces the height of the given Image to be newHeight by
+//           removing horizontal seams. The image is carved in place, never
+//           rotated, and the result is the same as rotating it left,
+//           reducing its width and rotating it back.
 void seam_carve_height(Image *img, int newHeight);
 
+// REQUIRES: carver points to a SeamCarver, img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Same as seam_carve_width, using the buffers, precision and
+//           energy source of *carver.
+void SeamCarver_carve_width(SeamCarver* carver, Image *img, int newWidth);
+
+// REQUIRES: carver points to a SeamCarver, img points to a valid Image
+//           0 < newHeight && newHeight <= Image_height(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Same as seam_carve_height, using the buffers, precision and
+//           energy source of *carver.
+void SeamCarver_carve_height(SeamCarver* carver, Image *img, int newHeight);
+
+// REQUIRES: carver points to a SeamCarver, img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           0 < newHeight && newHeight <= Image_height(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Same as seam_carve, using the buffers, precision and
+//           energy source of *carver.
+void SeamCarver_carve(SeamCarver* carver, Image *img, int newWidth,
+                      int newHeight);
+
+// REQUIRES: carver points to a SeamCarver, view points to a valid
+//           Image_View
+//           0 < newWidth && newWidth <= Image_View_width(view)
+// MODIFIES: *carver, *view->img
+// EFFECTS:  Reduces the width of the view to newWidth, with the same
+//           result as materializing it, calling SeamCarver_carve_width and
+//           writing the copy back. An upright view is carved in place, and
+//           so is one turned to the left, which is SeamCarver_carve_height.
+//           The other two turns would search their seams from the opposite
+//           side of the image, which the in-place search cannot do with
+//           the same ties, so they are materialized and written back.
+void SeamCarver_carve_width_view(SeamCarver* carver, Image_View* view,
+                                 int newWidth);
+
 // REQUIRES: img points to a valid Image
 //           0 < newWidth && newWidth <= Image_width(img)
 //           0 < newHeight && newHeight <= Image_height(img)
@@ -86,5 +326,27 @@ void seam_carve(Image *img, int newWidth, int newHeight);
 //           not exceed the bounds of src.
 void crop_square_centered_at_max_energy(const Image* src, Image* dst);
 
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           that SeamCarver_carve with a new SeamCarver of the given
+//           precision and energy source holds at once while carving a
+//           width x height image with the given channels, not counting
+//           the image itself.
+long long SeamCarver_memory(int width, int height, int channels,
+                            Carve_Precision precision, Energy_Source source);
+
+// REQUIRES: carver points to a SeamCarver
+// EFFECTS:  Returns the tracked memory (see memory.hpp), in bytes, that
+//           the buffers of *carver hold, kept for the next image.
+long long SeamCarver_held_memory(const SeamCarver* carver);
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory, in bytes, that
+//           crop_square_centered_at_max_energy holds at once for a
+//           width x height source with the given channels, output
+//           included and the source not.
+long long crop_square_centered_at_max_energy_memory(int width, int height,
+                                                    int channels);
+
 
 #endif // PROCESSING_HPP
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include "profile.hpp"
+#include "memory.hpp"
+
+bool profile_on = false;
+
+// Totals per stage.
+static std::atomic<long long> stage_calls[PROFILE_STAGE_COUNT];
+static std::atomic<long long> stage_nanoseconds[PROFILE_STAGE_COUNT];
+static std::atomic<long long> stage_bytes[PROFILE_STAGE_COUNT];
+static std::atomic<long long> stage_peak_memory[PROFILE_STAGE_COUNT];
+static std::atomic<long long> stage_held_memory[PROFILE_STAGE_COUNT];
+
+// The most memory held so far during the innermost timed block running
+// on this thread.
+static thread_local long long scope_peak = 0;
+
+// One timed block, for the trace.
+struct Trace_Event {
+  Profile_Stage stage;
+  int thread;
+  long long start;
+  long long duration;
+  long long bytes;
+};
+
+static bool tracing = false;
+static std::mutex trace_mutex;
+static std::vector<Trace_Event> trace_events;
+static std::chrono::steady_clock::time_point epoch;
+
+// Small numbers for threads, in the order they first record something.
+static std::atomic<int> next_thread_number(0);
+
+static int thread_number() {
+  thread_local int number = next_thread_number++;
+  return number;
+}
+
+// MODIFIES: the profiling state
+// EFFECTS:  Clears all counters and turns profiling on. If trace is true,
+//           every timed block is also kept as a trace event. Not safe to
+//           call while instrumented code is running on other threads.
+void profile_start(bool trace) {
+  for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+    stage_calls[s] = 0;
+    stage_nanoseconds[s] = 0;
+    stage_bytes[s] = 0;
+    stage_peak_memory[s] = 0;
+    stage_held_memory[s] = 0;
+  }
+  memory_reset_peak();
+  trace_events.clear();
+  tracing = trace;
+  epoch = std::chrono::steady_clock::now();
+  profile_on = true;
+}
+
+// EFFECTS:  Returns the time in nanoseconds since profile_start.
+long long profile_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - epoch).count();
+}
+
+// REQUIRES: profile_start has been called
+// MODIFIES: the profiling state
+// EFFECTS:  Records one call of stage that started at the given time
+//           (from profile_now), ended now and processed the given number
+//           of bytes. Safe to call from several threads.
+void profile_record(Profile_Stage stage, long long start, long long bytes) {
+  long long duration = profile_now() - start;
+  stage_calls[stage].fetch_add(1, std::memory_order_relaxed);
+  stage_nanoseconds[stage].fetch_add(duration, std::memory_order_relaxed);
+  stage_bytes[stage].fetch_add(bytes, std::memory_order_relaxed);
+
+  if (tracing) {
+    Trace_Event event = { stage, thread_number(), start, duration, bytes };
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_events.push_back(event);
+  }
+}
+
+// EFFECTS:  Starts following the memory held for a timed block on this
+//           thread, and returns what profile_leave_scope needs to resume
+//           following the block around it. Use it through PROFILE_SCOPE.
+long long profile_enter_scope() {
+  long long outerPeak = scope_peak;
+  scope_peak = memory_current();
+  return outerPeak;
+}
+
+// REQUIRES: outerPeak came from the matching profile_enter_scope
+// MODIFIES: the profiling state
+// EFFECTS:  Records the most memory held during the timed block of stage
+//           that is ending, and the memory held at its end.
+void profile_leave_scope(Profile_Stage stage, long long outerPeak) {
+  long long seen = stage_peak_memory[stage].load(std::memory_order_relaxed);
+  while (scope_peak > seen &&
+         !stage_peak_memory[stage].compare_exchange_weak(seen, scope_peak)) {
+  }
+  stage_held_memory[stage].store(memory_current(), std::memory_order_relaxed);
+  // the block around this one held at least as much
+  scope_peak = std::max(outerPeak, scope_peak);
+}
+
+// MODIFIES: the profiling state
+// EFFECTS:  Notes that total bytes are held, for the peaks of the timed
+//           blocks running on this thread. Called by memory_allocate.
+void profile_note_memory(long long total) {
+  scope_peak = std::max(scope_peak, total);
+}
+
+// EFFECTS:  Returns the name of the stage, such as "energy".
+const char* profile_stage_name(Profile_Stage stage) {
+  static const char* const names[PROFILE_STAGE_COUNT] = {
+    "read", "energy", "energy_update", "cost", "cost_update", "seam",
+    "remove", "rotate", "carve", "crop", "write"
+  };
+  return names[stage];
+}
+
+// MODIFIES: os
+// EFFECTS:  Writes a JSON object with the wall time, call count and bytes
+//           processed of each stage, the most memory held while it ran
+//           and the memory held when it last finished, and the peak and
+//           current memory of the whole run.
+void profile_report(std::ostream& os) {
+  // stages nest (carve contains energy, cost, ...), so the times of the
+  // stages do not add up to the total
+  os << "{\"total_seconds\": " << profile_now() * 1e-9
+     << ", \"peak_memory\": " << memory_peak()
+     << ", \"current_memory\": " << memory_current() << ", \"stages\": {";
+  bool first = true;
+  for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+    if (stage_calls[s] == 0) {
+      continue;
+    }
+    os << (first ? "" : ", ") << "\"" << profile_stage_name(Profile_Stage(s))
+       << "\": {\"seconds\": " << stage_nanoseconds[s] * 1e-9
+       << ", \"calls\": " << stage_calls[s]
+       << ", \"bytes\": " << stage_bytes[s]
+       << ", \"peak_memory\": " << stage_peak_memory[s]
+       << ", \"held_memory\": " << stage_held_memory[s] << "}";
+    first = false;
+  }
+  os << "}}" << std::endl;
+}
+
+// MODIFIES: the named file, *error
+// EFFECTS:  Writes the recorded trace events in the Chrome trace event
+//           format (viewable in chrome://tracing or Perfetto). Returns
+//           false and sets *error if the file cannot be written.
+bool profile_write_trace(const std::string& filename, std::string* error) {
+  std::ofstream out(filename);
+  if (!out) {
+    *error = "cannot open " + filename + " for writing";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  out << "{\"traceEvents\": [\n";
+  for (size_t i = 0; i < trace_events.size(); i++) {
+    const Trace_Event& event = trace_events[i];
+    // timestamps are in microseconds
+    out << "{\"name\": \"" << profile_stage_name(event.stage)
+        << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+        << ", \"ts\": " << event.start / 1000.0
+        << ", \"dur\": " << event.duration / 1000.0
+        << ", \"args\": {\"bytes\": " << event.bytes << "}}"
+        << (i + 1 < trace_events.size() ? ",\n" : "\n");
+  }
+  out << "]}" << std::endl;
+
+  if (!out) {
+    *error = "error while writing " + filename;
+    return false;
+  }
+  return true;
+}
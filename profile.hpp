@@ -0,0 +1,117 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+/* profile.hpp
+ * Opt-in timing of the stages of reading, processing and writing an
+ * image, and of the memory (see memory.hpp) held while they run. While
+ * profiling is off, an instrumented block costs one test of a flag;
+ * building with -DRESIZE_NO_PROFILE removes the instrumentation
+ * altogether.
+ */
+
+#include <ostream>
+#include <string>
+
+// The stages that are timed separately.
+enum Profile_Stage {
+  PROFILE_READ,
+  PROFILE_ENERGY,
+  PROFILE_ENERGY_UPDATE,
+  PROFILE_COST,
+  PROFILE_COST_UPDATE,
+  PROFILE_SEAM,
+  PROFILE_REMOVE,
+  PROFILE_ROTATE,
+  PROFILE_CARVE,
+  PROFILE_CROP,
+  PROFILE_WRITE,
+  PROFILE_STAGE_COUNT
+};
+
+// True while profiling is on. Only profile_start changes it.
+extern bool profile_on;
+
+// MODIFIES: the profiling state
+// EFFECTS:  Clears all counters and turns profiling on. If trace is true,
+//           every timed block is also kept as a trace event. Not safe to
+//           call while instrumented code is running on other threads.
+void profile_start(bool trace);
+
+// EFFECTS:  Returns the time in nanoseconds since profile_start.
+long long profile_now();
+
+// REQUIRES: profile_start has been called
+// MODIFIES: the profiling state
+// EFFECTS:  Records one call of stage that started at the given time
+//           (from profile_now), ended now and processed the given number
+//           of bytes. Safe to call from several threads.
+void profile_record(Profile_Stage stage, long long start, long long bytes);
+
+// EFFECTS:  Starts following the memory held for a timed block on this
+//           thread, and returns what profile_leave_scope needs to resume
+//           following the block around it. Use it through PROFILE_SCOPE.
+long long profile_enter_scope();
+
+// REQUIRES: outerPeak came from the matching profile_enter_scope
+// MODIFIES: the profiling state
+// EFFECTS:  Records the most memory held during the timed block of stage
+//           that is ending, and the memory held at its end.
+void profile_leave_scope(Profile_Stage stage, long long outerPeak);
+
+// MODIFIES: the profiling state
+// EFFECTS:  Notes that total bytes are held, for the peaks of the timed
+//           blocks running on this thread. Called by memory_allocate.
+void profile_note_memory(long long total);
+
+// EFFECTS:  Returns the name of the stage, such as "energy".
+const char* profile_stage_name(Profile_Stage stage);
+
+// MODIFIES: os
+// EFFECTS:  Writes a JSON object with the wall time, call count and bytes
+//           processed of each stage, the most memory held while it ran
+//           and the memory held when it last finished, and the peak and
+//           current memory of the whole run.
+void profile_report(std::ostream& os);
+
+// MODIFIES: the named file, *error
+// EFFECTS:  Writes the recorded trace events in the Chrome trace event
+//           format (viewable in chrome://tracing or Perfetto). Returns
+//           false and sets *error if the file cannot be written.
+bool profile_write_trace(const std::string& filename, std::string* error);
+
+// Times the block it is declared in as one call of a stage. Use it
+// through PROFILE_SCOPE.
+struct Profile_Scope {
+  Profile_Stage stage;
+  long long bytes;
+  bool active;
+  long long start;
+  long long outerPeak;
+
+  Profile_Scope(Profile_Stage stage_in, long long bytes_in)
+    : stage(stage_in), bytes(bytes_in), active(profile_on),
+      start(active ? profile_now() : 0),
+      outerPeak(active ? profile_enter_scope() : 0) {}
+
+  ~Profile_Scope() {
+    if (active) {
+      profile_record(stage, start, bytes);
+      profile_leave_scope(stage, outerPeak);
+    }
+  }
+
+  Profile_Scope(const Profile_Scope&) = delete;
+  Profile_Scope& operator=(const Profile_Scope&) = delete;
+};
+
+// PROFILE_SCOPE(stage, bytes) times the rest of the enclosing block;
+// PROFILE_BYTES(bytes) changes the byte count reported for it.
+#ifdef RESIZE_NO_PROFILE
+#define PROFILE_SCOPE(stage, n) do {} while (false)
+#define PROFILE_BYTES(n) do {} while (false)
+#else
+#define PROFILE_SCOPE(stage, n) Profile_Scope profile_scope((stage), (n))
+#define PROFILE_BYTES(n) (profile_scope.bytes = (n))
+#endif
+
+#endif // PROFILE_HPP
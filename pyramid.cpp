@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <vector>
+#include "pyramid.hpp"
+#include "band.hpp"
+#include "Matrix.hpp"
+#include "processing.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+// Sets dst to the view, which is upright or turned to the left,
+// downsampled by scale: every pixel is the average of a scale x scale
+// block, and the last row and column of blocks also take any leftover
+// pixels. The image is read in its own row order either way.
+static void downsample(const Image_View* view, Image* dst, int scale) {
+  const int width = Image_View_width(view);
+  const int height = Image_View_height(view);
+  const int coarseWidth = max(1, width / scale);
+  const int coarseHeight = max(1, height / scale);
+  Image_init(dst, coarseWidth, coarseHeight, Image_channels(view->img));
+
+  vector<int> columnOf(width);
+  vector<int> columnCount(coarseWidth, 0);
+  for (int c = 0; c < width; c++) {
+    columnOf[c] = min(c / scale, coarseWidth - 1);
+    columnCount[columnOf[c]]++;
+  }
+  vector<int> rowOf(height);
+  vector<int> rowCount(coarseHeight, 0);
+  for (int r = 0; r < height; r++) {
+    rowOf[r] = min(r / scale, coarseHeight - 1);
+    rowCount[rowOf[r]]++;
+  }
+
+  // the coarse pixel of image pixel (y, x) is sums[byRow[y] + byColumn[x]]
+  const Image* img = view->img;
+  const int imageWidth = Image_width(img);
+  const int imageHeight = Image_height(img);
+  vector<int> byRow(imageHeight);
+  vector<int> byColumn(imageWidth);
+  const bool sideways = view->turns == 1;
+  for (int y = 0; y < imageHeight; y++) {
+    byRow[y] = sideways ? columnOf[y] : rowOf[y] * coarseWidth;
+  }
+  for (int x = 0; x < imageWidth; x++) {
+    byColumn[x] = sideways ? rowOf[imageWidth - 1 - x] * coarseWidth : columnOf[x];
+  }
+
+  vector<int> sums(static_cast<size_t>(coarseWidth) * coarseHeight);
+  for (int ch = 0; ch < Image_channels(img); ch++) {
+    fill(sums.begin(), sums.end(), 0);
+    for (int y = 0; y < imageHeight; y++) {
+      const unsigned char* row = Image_row(img, ch, y);
+      int* sumRow = &sums[byRow[y]];
+      for (int x = 0; x < imageWidth; x++) {
+        sumRow[byColumn[x]] += row[x];
+      }
+    }
+
+    for (int i = 0; i < coarseHeight; i++) {
+      unsigned char* out = Image_row(dst, ch, i);
+      for (int j = 0; j < coarseWidth; j++) {
+        int count = columnCount[j] * rowCount[i];
+        out[j] = static_cast<unsigned char>((sums[i * coarseWidth + j] + count / 2) / count);
+      }
+    }
+  }
+}
+
+// Finds the seam of the whole view, for when the band has no seam, with
+// energy as the buffer for its energies.
+static void full_seam(const Image_View* view, Matrix* energy, vector<int> &seam) {
+  Seam_Steps steps;
+  compute_energy_matrix_view(view, energy);
+  find_minimal_vertical_seam_by_steps(energy, &steps, &seam);
+}
+
+// seam_carve_width_pyramid on a view that is upright or turned to the
+// left: the image is read and carved in place either way.
+static void carve_view(Image_View* view, int newWidth,
+                       const Pyramid_Options &options) {
+  const int height = Image_View_height(view);
+  int runs = Image_View_width(view) - newWidth;
+
+  int scale = 1;
+  for (int level = 0; level < options.levels; level++) {
+    if (Image_View_width(view) / (2 * scale) < PYRAMID_MIN_SIZE ||
+        height / (2 * scale) < PYRAMID_MIN_SIZE) {
+      break;
+    }
+    scale *= 2;
+  }
+  if (scale == 1 || runs < scale) {
+    SeamCarver carver;
+    SeamCarver_carve_width_view(&carver, view, newWidth);
+    return;
+  }
+
+  // the band reaches past the coarse pixel on both sides, so the seams
+  // inside it can still move between neighbouring coarse columns
+  const int radius = options.band > 0 ? options.band : scale + 2;
+
+  // energy holds the full-size energies here, then the coarse ones and
+  // those of any full_seam, so it is only ever allocated once
+  Matrix energy;
+  Matrix cost;
+  // the border value is the largest interior energy, which does not
+  // depend on which way the view is turned
+  compute_energy_matrix(view->img, &energy);
+  const int border = *Matrix_at(&energy, 0, 0);
+
+  Image coarse;
+  downsample(view, &coarse, scale);
+  const int coarseHeight = Image_height(&coarse);
+
+  Seam_Band band;
+  Seam_Band_init(&band, height, 2 * radius + scale + 1);
+  vector<int> seam;
+  Seam_Removal removal;
+
+  while (runs > 0) {
+    compute_energy_matrix(&coarse, &energy);
+    compute_vertical_cost_matrix(&energy, &cost);
+    vector<int> coarseSeam = find_minimal_vertical_seam(&cost);
+
+    int width = Image_View_width(view);
+    for (int r = 0; r < height; r++) {
+      int center = coarseSeam[min(r / scale, coarseHeight - 1)] * scale + scale / 2;
+      band.lo[r] = max(0, min(width - 1, center - radius));
+      band.hi[r] = max(band.lo[r], min(width - 1, center + radius));
+    }
+
+    // each coarse column stands for scale full-resolution columns
+    const int group = min(scale, runs);
+    for (int k = 0; k < group; k++) {
+      Seam_Band_energy(view, &band, border);
+      if (Seam_Band_cost(&band, width, height)) {
+        Seam_Band_seam(&band, width, height, &seam);
+      } else {
+        full_seam(view, &energy, seam);
+      }
+      remove_vertical_seam_view(view, seam, &removal);
+      width--;
+
+      // columns right of the seam moved left by one
+      for (int r = 0; r < height; r++) {
+        band.hi[r] = min(width - 1, band.hi[r] - (seam[r] <= band.hi[r] ? 1 : 0));
+        band.lo[r] = max(0, band.lo[r] - (seam[r] < band.lo[r] ? 1 : 0));
+        band.lo[r] = min(band.lo[r], width - 1);
+        band.hi[r] = max(band.hi[r], band.lo[r]);
+      }
+    }
+    runs -= group;
+
+    if (Image_width(&coarse) > 1) {
+      remove_vertical_seam(&coarse, coarseSeam);
+    }
+  }
+}
+
+// REQUIRES: img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           0 <= options.levels && 0 <= options.band
+// MODIFIES: *img
+// EFFECTS:  Reduces the width of the given Image to be newWidth. A seam is
+//           found on the coarse level, and then 2^levels seams are found
+//           one after another at full resolution, each restricted to a
+//           band around the coarse seam. The band's energies use the
+//           border value of the original image. If there are no levels
+//           to use, this is the same as seam_carve_width.
+void seam_carve_width_pyramid(Image *img, int newWidth,
+                              const Pyramid_Options &options) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  Image_View view;
+  Image_View_init(&view, img);
+  carve_view(&view, newWidth, options);
+}
+
+// REQUIRES: img points to a valid Image
+//           0 < newHeight && newHeight <= Image_height(img)
+//           0 <= options.levels && 0 <= options.band
+// MODIFIES: *img
+// EFFECTS:  Reduces the height of the given Image to be newHeight. The
+//           result is the same as rotating it left, calling
+//           seam_carve_width_pyramid and rotating it back, but the image
+//           is never rotated: the carving works on a view of it turned to
+//           the left.
+void seam_carve_height_pyramid(Image *img, int newHeight,
+                               const Pyramid_Options &options) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  Image_View view;
+  Image_View_init(&view, img);
+  Image_View_rotate_left(&view);
+  carve_view(&view, newHeight, options);
+}
+
+// REQUIRES: img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           0 < newHeight && newHeight <= Image_height(img)
+//           0 <= options.levels && 0 <= options.band
+// MODIFIES: *img
+// EFFECTS:  Like seam_carve, but carves with seam_carve_width_pyramid and
+//           seam_carve_height_pyramid.
+void seam_carve_pyramid(Image *img, int newWidth, int newHeight,
+                        const Pyramid_Options &options) {
+  seam_carve_width_pyramid(img, newWidth, options);
+  seam_carve_height_pyramid(img, newHeight, options);
+}
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           that the pyramid carving functions hold at once for a
+//           width x height image with the given channels, not counting
+//           the image itself.
+long long seam_carve_pyramid_memory(int width, int height, int channels) {
+  // the energies, the steps of full_seam, and the coarse image and
+  // costs, at most a quarter of the size
+  const long long pixels = static_cast<long long>(width) * height;
+  return (sizeof(int) + sizeof(signed char)) * pixels +
+         (channels + sizeof(int)) * pixels / 4;
+}
@@ -0,0 +1,70 @@
+#ifndef PYRAMID_HPP
+#define PYRAMID_HPP
+
+/* pyramid.hpp
+ * Coarse-to-fine seam carving for very large images. Seams are found on
+ * a downsampled copy of the image and then refined at full resolution
+ * within a narrow band around them, which is much cheaper than a full
+ * dynamic program per seam and gives nearly the same result.
+ */
+
+#include "Image.hpp"
+
+// Settings for the pyramid carving functions.
+struct Pyramid_Options {
+  // How many times the image is halved for the coarse level. More levels
+  // are faster but follow the image less closely. Levels that would make
+  // the coarse image smaller than PYRAMID_MIN_SIZE pixels are skipped.
+  int levels;
+  // Half-width, in full-resolution pixels, of the band a seam is refined
+  // in; 0 picks one coarse pixel plus a margin. Wider bands are slower
+  // and closer to the exact result.
+  int band;
+};
+
+// Smallest width or height the coarse level is allowed to have.
+const int PYRAMID_MIN_SIZE = 32;
+
+// REQUIRES: img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           0 <= options.levels && 0 <= options.band
+// MODIFIES: *img
+// EFFECTS:  Reduces the width of the given Image to be newWidth. A seam is
+//           found on the coarse level, and then 2^levels seams are found
+//           one after another at full resolution, each restricted to a
+//           band around the coarse seam. The band's energies use the
+//           border value of the original image. If there are no levels
+//           to use, this is the same as seam_carve_width.
+void seam_carve_width_pyramid(Image *img, int newWidth,
+                              const Pyramid_Options &options);
+
+// REQUIRES: img points to a valid Image
+//           0 < newHeight && newHeight <= Image_height(img)
+//           0 <= options.levels && 0 <= options.band
+// MODIFIES: *img
+// EFFECTS:  Reduces the height of the given Image to be newHeight. The
+//           result is the same as rotating it left, calling
+//           seam_carve_width_pyramid and rotating it back, but the image
+//           is never rotated: the carving works on a view of it turned to
+//           the left.
+void seam_carve_height_pyramid(Image *img, int newHeight,
+                               const Pyramid_Options &options);
+
+// REQUIRES: img points to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+//           0 < newHeight && newHeight <= Image_height(img)
+//           0 <= options.levels && 0 <= options.band
+// MODIFIES: *img
+// EFFECTS:  Like seam_carve, but carves with seam_carve_width_pyramid and
+//           seam_carve_height_pyramid.
+void seam_carve_pyramid(Image *img, int newWidth, int newHeight,
+                        const Pyramid_Options &options);
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           that the pyramid carving functions hold at once for a
+//           width x height image with the given channels, not counting
+//           the image itself.
+long long seam_carve_pyramid_memory(int width, int height, int channels);
+
+#endif // PYRAMID_HPP
@@ -1,91 +1,910 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include "Image.hpp"
 #include "Matrix.hpp"
+#include "crop.hpp"
+#include "memory.hpp"
+#include "ppm.hpp"
 #include "processing.hpp"
-#include <fstream>
+#include "pyramid.hpp"
+#include "seam_index.hpp"
+#include "sequence.hpp"
+#include "server.hpp"
+#include "profile.hpp"
+#include "ThreadPool.hpp"
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <vector>
 
-//written by Ian Kim 
+//written by Ian Kim
 
 using namespace std;
 
-int main(int argc, char *argv[]) {
-  if (!(argc == 4 || argc == 5 || argc == 3)) {
-    cout << "Usage: resize.exe IN_FILENAME OUT_FILENAME WIDTH [HEIGHT]\n"
-     << "WIDTH and HEIGHT must be less than or equal to original" << endl;
+static void print_usage() {
+  cout << "Usage: resize.exe [--format p3|p5|p6] [--threads N] IN_FILENAME OUT_FILENAME WIDTH [HEIGHT]\n"
+   << "       resize.exe [--format p3|p5|p6] [--threads N] --batch MANIFEST\n"
+   << "       resize.exe [--format p3|p5|p6] [--threads N] --sequence IN_PATTERN OUT_PATTERN WIDTH\n"
+   << "       resize.exe [--format p3|p5|p6] [--threads N] --serve [--socket PATH]\n"
+   << "WIDTH and HEIGHT must be less than or equal to original\n"
+   << "Without WIDTH, a square around the most detailed area is cropped out\n"
+   << "--format picks the output format (default: same as the input)\n"
+   << "--threads sets how many threads to use (default: one per core)\n"
+   << "--profile prints the time spent in each stage as JSON to stderr\n"
+   << "--trace FILE also writes a Chrome trace-event file\n"
+   << "--pyramid LEVELS finds seams on an image halved LEVELS times and refines\n"
+   << "  them at full size: faster on large images, more levels is faster still\n"
+   << "--band PIXELS sets how far refined seams may stray from the coarse ones,\n"
+   << "  or with --sequence from the previous frame's seams\n"
+   << "--index keeps the seam order of IN_FILENAME in IN_FILENAME.seams, so later\n"
+   << "  runs at any width skip the seam search\n"
+   << "--crop WIDTHxHEIGHT crops, without WIDTH, the window of that size with the\n"
+   << "  most detail instead of a 512x512 square around its most detailed pixel\n"
+   << "--precision 16|32|steps sets the integer width of the seam search; 16 is\n"
+   << "  often faster and steps uses the least memory, and all find the same seams\n"
+   << "  (default: 32)\n"
+   << "--luma computes the seam energies of color images from their brightness\n"
+   << "  alone, which is faster (not with --pyramid or --index)\n"
+   << "--proxy FACTOR finds the square crop's center on a copy of the image\n"
+   << "  shrunk FACTOR times first, then at full size only near it: faster on\n"
+   << "  large images, but the center may differ a little\n"
+   << "--stream crops without WIDTH while reading the input in two passes instead\n"
+   << "  of loading it, for inputs too large for memory\n"
+   << "--batch runs every job in MANIFEST, one per line in the form\n"
+   << "  IN_FILENAME OUT_FILENAME [WIDTH [HEIGHT]]\n"
+   << "  and prints a status line per job\n"
+   << "--sequence carves the numbered frames of a video, such as frame%04d.ppm,\n"
+   << "  searching each frame's seams near the previous frame's; numbering starts\n"
+   << "  at 0 or 1 and stops at the first missing frame\n"
+   << "--scene-change N sets the mean pixel difference (0-255) from the previous\n"
+   << "  frame above which a frame is carved with a full search (default: 24)\n"
+   << "--serve answers resize requests on stdin and stdout until quit, keeping\n"
+   << "  its buffers and threads between them (see server.hpp for the protocol)\n"
+   << "--socket PATH serves requests on a Unix domain socket at PATH instead\n"
+   << "--max-memory BYTES[K|M|G] picks methods that resize within BYTES of image\n"
+   << "  and matrix memory, or refuses a job that can't with status 8" << endl;
+}
+
+// How every job is run, from the command-line options.
+struct Job_Options {
+  bool formatGiven;
+  PPM_Format outFormat;
+  // seams are carved with the pyramid functions if pyramid.levels is not 0
+  Pyramid_Options pyramid;
+  // narrow with a seam index kept next to the input
+  bool useIndex;
+  // size of the window crop_max_energy_window cuts out, or 0 to crop
+  // with crop_square_centered_at_max_energy
+  int cropWidth;
+  int cropHeight;
+  // crop with crop_square_centered_at_max_energy_file, without loading
+  // the whole input
+  bool stream;
+  // factor the square crop shrinks the image by to search it first with
+  // crop_square_centered_at_max_energy_proxy, or 0 for an exact search
+  int cropProxy;
+  // precision and energy source of the SeamCarver used for plain carving
+  Carve_Precision precision;
+  Energy_Source source;
+  // most bytes of tracked memory (see memory.hpp) a job may use, or 0 for
+  // no limit
+  long long maxMemory;
+};
+
+// Suffix of the file a seam index is kept in, after the input's name.
+static const char* const SEAM_INDEX_SUFFIX = ".seams";
+
+// Sets *img to its seam-carved version at newWidth, using the index in
+// file + SEAM_INDEX_SUFFIX. The index is built and saved if it is missing
+// or belongs to another image; failing to save it is not an error.
+static void narrow_with_index(Image *img, const string &file, int newWidth) {
+  Seam_Index index;
+  string indexFile = file + SEAM_INDEX_SUFFIX;
+  string error;
+  if (!Seam_Index_read_file(&index, indexFile, &error) ||
+      !Seam_Index_matches(&index, img)) {
+    Seam_Index_init(&index, img);
+    Seam_Index_write_file(&index, indexFile, &error);
+  }
+
+  Image narrowed;
+  Seam_Index_apply(&index, img, &narrowed, newWidth);
+  *img = narrowed;
+}
+
+// Buffers for carving, kept for the next job on the same thread so that
+// batch jobs of similar size don't allocate them again.
+static thread_local SeamCarver job_buffers;
+
+// Returns the carving buffers of this thread, set to the precision and
+// energy source options pick.
+static SeamCarver* job_carver(const Job_Options &options) {
+  job_buffers.precision = options.precision;
+  job_buffers.source = options.source;
+  return &job_buffers;
+}
+
+// Reduces the width of img with the method options pick. An image that
+// did not come from a file (file is empty) has no seam index.
+static void carve_width(Image *img, const string &file, int newWidth,
+                        const Job_Options &options) {
+  if (options.useIndex && !file.empty()) {
+    narrow_with_index(img, file, newWidth);
+  } else if (options.pyramid.levels > 0) {
+    seam_carve_width_pyramid(img, newWidth, options.pyramid);
+  } else {
+    SeamCarver_carve_width(job_carver(options), img, newWidth);
+  }
+}
+
+// Reduces the height of img with the method options pick. The seam index
+// only covers the width of the input, so it is not used here.
+static void carve_height(Image *img, int newHeight, const Job_Options &options) {
+  if (options.pyramid.levels > 0) {
+    seam_carve_height_pyramid(img, newHeight, options.pyramid);
+  } else {
+    SeamCarver_carve_height(job_carver(options), img, newHeight);
+  }
+}
+
+// Returns the most tracked memory resizing a width x height image with
+// the given channels as options pick takes, the image included. sizes
+// is the number of sizes the job gives, and file is false if the image
+// did not come from a file.
+static long long job_memory(int width, int height, int channels, size_t sizes,
+                            bool file, const Job_Options &options) {
+  const long long input = static_cast<long long>(width) * height * channels;
+  if (sizes == 0) {
+    if (options.cropWidth > 0) {
+      return input + crop_max_energy_window_memory(width, height, channels,
+                                                   options.cropWidth, options.cropHeight);
+    }
+    if (options.stream && file) {
+      return crop_square_centered_at_max_energy_file_memory(width, height, channels);
+    }
+    if (options.cropProxy > 0) {
+      return input + crop_square_centered_at_max_energy_proxy_memory(width, height, channels,
+                                                                      options.cropProxy);
+    }
+    return input + crop_square_centered_at_max_energy_memory(width, height, channels);
+  }
+  // the height is carved after the width, on a smaller image
+  long long carve = options.pyramid.levels > 0
+                  ? seam_carve_pyramid_memory(width, height, channels)
+                  : SeamCarver_memory(width, height, channels, options.precision,
+                                      options.source);
+  if (options.useIndex && file) {
+    carve = max(carve, Seam_Index_memory(width, height, channels));
+  }
+  return input + carve;
+}
+
+// job_memory with the carving buffers this thread kept from earlier jobs
+// still held. Plain carving at the precision and from the source they
+// were grown for reuses them, in place if they are already as large as
+// it needs; anything else allocates beside them.
+static long long warm_job_memory(int width, int height, int channels, size_t sizes,
+                                 bool file, const Job_Options &options) {
+  const long long memory = job_memory(width, height, channels, sizes, file, options);
+  const long long held = SeamCarver_held_memory(&job_buffers);
+  const bool reused = sizes > 0 && options.pyramid.levels == 0 &&
+                      !(options.useIndex && file) &&
+                      options.precision == job_buffers.precision &&
+                      options.source == job_buffers.source;
+  if (reused) {
+    const long long carve = SeamCarver_memory(width, height, channels, options.precision,
+                                              options.source);
+    if (held >= carve) {
+      return memory - carve + held;
+    }
+  }
+  return memory + held;
+}
+
+// Changes *options to methods that resize a width x height image with
+// the given channels within options->maxMemory, trying, in turn, a
+// streamed crop, carving without the seam index, without the pyramid and
+// at lower precisions. Only changes that give the same or a closer
+// result are made. A note on each change is added to *note. The carving
+// buffers kept from earlier jobs on this thread are released only if
+// the methods picked would not fit with them held. Returns true if the
+// methods fit; otherwise sets *message and returns false. sizes and file
+// are as for job_memory.
+static bool plan_job(int width, int height, int channels, size_t sizes, bool file,
+                     Job_Options *options, string *note, string *message) {
+  auto fits = [&]() {
+    return job_memory(width, height, channels, sizes, file, *options) <= options->maxMemory;
+  };
+  auto keep = [&]() {
+    if (warm_job_memory(width, height, channels, sizes, file, *options) > options->maxMemory) {
+      job_buffers = SeamCarver();
+    }
+    return true;
+  };
+  if (fits()) {
+    return keep();
+  }
+  const long long needed = job_memory(width, height, channels, sizes, file, *options);
+
+  if (sizes == 0 && options->cropWidth == 0 && file && !options->stream) {
+    options->stream = true;
+    *note += "cropping with --stream to fit --max-memory\n";
+  }
+  if (sizes > 0 && options->useIndex && file && !fits()) {
+    options->useIndex = false;
+    *note += "carving without --index to fit --max-memory\n";
+  }
+  if (sizes > 0 && options->pyramid.levels > 0 && !fits()) {
+    options->pyramid.levels = 0;
+    *note += "carving without --pyramid to fit --max-memory\n";
+  }
+  if (sizes > 0 && options->precision == CARVE_PRECISION_32 && !fits()) {
+    options->precision = CARVE_PRECISION_16;
+    *note += "carving with --precision 16 to fit --max-memory\n";
+  }
+  if (sizes > 0 && options->precision == CARVE_PRECISION_16 && !fits()) {
+    options->precision = CARVE_PRECISION_STEPS;
+    *note += "carving with --precision steps to fit --max-memory\n";
+  }
+  if (fits()) {
+    return keep();
+  }
+  job_buffers = SeamCarver();
+  *message = "Not enough memory: a " + to_string(width) + "x" + to_string(height) +
+             " image needs " + to_string(needed) + " bytes as asked and " +
+             to_string(job_memory(width, height, channels, sizes, file, *options)) +
+             " at least, --max-memory is " + to_string(options->maxMemory);
+  return false;
+}
+
+// Plans the job for the image whose PPM header reader is at, as plan_job
+// does. An image without a readable header passes, so that reading it
+// reports the error.
+static bool plan_read(PPM_Reader *reader, size_t sizes, bool file,
+                      Job_Options *options, string *note, string *message) {
+  PPM_Header header;
+  string error;
+  if (!PPM_read_header(reader, &header, &error)) {
+    return true;
+  }
+  const int channels = header.format == PPM_P5 ? 1 : 3;
+  return plan_job(header.width, header.height, channels, sizes, file, options,
+                  note, message);
+}
+
+// Why a job's WIDTH or HEIGHT was refused.
+static const char* const SIZE_ERROR = "WIDTH and HEIGHT must be less than or equal to original";
+
+// Crops or carves img as the sizes after the file names of a job ask
+// ([WIDTH [HEIGHT]]). file names the input for the seam index and is
+// empty if the image did not come from a file, in which case no index is
+// used. Returns 0 on success, or 3 or 5 if the size is out of range,
+// which is described in *message.
+static int resize_image(Image *img, const string &file, const vector<string> &sizes,
+                        const Job_Options &options, string *message) {
+  if (sizes.empty()) {
+    Image dst;
+    if (options.cropWidth > 0) {
+      crop_max_energy_window(img, &dst, options.cropWidth, options.cropHeight);
+    } else if (options.cropProxy > 0) {
+      crop_square_centered_at_max_energy_proxy(img, &dst, options.cropProxy);
+    } else {
+      crop_square_centered_at_max_energy(img, &dst);
+    }
+    *img = dst;
+  } else if (sizes.size() == 2) {
+    int qWidth = stoi(sizes[0]);
+    int qHeight = stoi(sizes[1]);
+
+    if (!(qWidth > 0) || !(qWidth <= Image_width(img)) || !(qHeight > 0) || !(qHeight <= Image_height(img))) {
+      *message = SIZE_ERROR;
+      return 3;
+    }
+
+    // the same order as seam_carve: width first, then height
+    carve_width(img, file, qWidth, options);
+    carve_height(img, qHeight, options);
+  } else {
+    int qWidth = stoi(sizes[0]);
+
+    if (!(qWidth > 0) || !(qWidth <= Image_width(img))) {
+      *message = SIZE_ERROR;
+      return 5;
+    }
+
+    carve_width(img, file, qWidth, options);
+  }
+  return 0;
+}
+
+// Runs one job as run_job does, with exactly the methods options pick.
+static int run_planned_job(const vector<string> &args, const Job_Options &options,
+                           string *message) {
+  string file = args[0];
+  string outfile = args[1];
+
+  Image img;
+  PPM_Format inFormat;
+  string error;
+  // a streamed crop reads only what it keeps of the input
+  const bool streamed = args.size() == 2 && options.stream && options.cropWidth == 0;
+  bool read = streamed ? crop_square_centered_at_max_energy_file(file, &img, &inFormat, &error)
+                       : Image_read_file(&img, file, &inFormat, &error);
+  if (!read) {
+    *message = "Error reading file: " + file + ": " + error;
+    return args.size() == 3 ? 4 : 2;
+  }
+  PPM_Format outFormat = options.formatGiven ? options.outFormat : inFormat;
+
+  if (!streamed) {
+    int status = resize_image(&img, file, vector<string>(args.begin() + 2, args.end()), options,
+                              message);
+    if (status != 0) {
+      return status;
+    }
+  }
+
+  if (!Image_write_file(&img, outfile, outFormat, &error)) {
+    *message = "Error writing file: " + error;
+    return 6;
+  }
+  return 0;
+}
+
+// Runs one job given its positional arguments (IN_FILENAME OUT_FILENAME
+// [WIDTH [HEIGHT]]). With options.maxMemory, the methods are first
+// planned from the input's header to fit it. Returns the exit status for
+// it: 0 on success, 2 or 4 if the input can't be read, 3 or 5 if the
+// size is out of range, 6 if the output can't be written and 8 if the
+// job doesn't fit in memory. Errors are described in *message.
+static int run_job(const vector<string> &args, const Job_Options &jobOptions,
+                   string *message) {
+  const string &file = args[0];
+  Job_Options options = jobOptions;
+  if (options.maxMemory > 0) {
+    PPM_Reader reader;
+    string note;
+    if (PPM_Reader_open(&reader, file.c_str(), message)) {
+      bool fits = plan_read(&reader, args.size() - 2, true, &options, &note, message);
+      PPM_Reader_close(&reader);
+      if (!fits) {
+        return 8;
+      }
+      istringstream notes(note);
+      for (string line; getline(notes, line); ) {
+        cerr << file << ": " << line << '\n';
+      }
+    }
+    message->clear();
+  }
+
+  try {
+    return run_planned_job(args, options, message);
+  } catch (const bad_alloc &) {
+    job_buffers = SeamCarver();
+    *message = "Out of memory resizing " + file;
+    return 8;
+  }
+}
+
+// Sets *name to pattern with its one printf-style decimal field (such as
+// %d or %04d) replaced by number. Returns false if pattern has no such
+// field, more than one, or any other % conversion.
+static bool frame_name(const string &pattern, int number, string *name) {
+  size_t field = pattern.find('%');
+  if (field == string::npos) {
+    return false;
+  }
+  size_t end = field + 1;
+  while (end < pattern.size() && isdigit(static_cast<unsigned char>(pattern[end]))) {
+    end++;
+  }
+  if (end == pattern.size() || pattern[end] != 'd' || end - field > 4 ||
+      pattern.find('%', end) != string::npos) {
+    return false;
+  }
+
+  string digits = to_string(number);
+  size_t width = end - field > 1 ? stoul(pattern.substr(field + 1, end - field - 1)) : 0;
+  if (digits.size() < width) {
+    digits.insert(0, width - digits.size(), '0');
+  }
+  *name = pattern.substr(0, field) + digits + pattern.substr(end + 1);
+  return true;
+}
+
+// Carves every frame of a numbered sequence (IN_PATTERN OUT_PATTERN
+// WIDTH) to WIDTH with one Sequence_Carver, so each frame's seams are
+// searched near the previous frame's. Numbering starts at 0, or 1 if
+// there is no frame 0, and stops at the first frame that doesn't exist.
+// Prints one tab-separated line per frame: number, how it was carved
+// (banded or full), input, output and milliseconds taken. Returns the
+// exit status: 0 on success, 1 for a bad pattern, 2 if a frame can't be
+// read or there are none, 5 if WIDTH is out of range and 6 if an output
+// can't be written.
+static int run_sequence(const vector<string> &args, const Job_Options &options,
+                        const Sequence_Options &sequenceOptions) {
+  string file;
+  string outfile;
+  if (!frame_name(args[0], 0, &file) || !frame_name(args[1], 0, &outfile)) {
+    cout << "Error: IN_PATTERN and OUT_PATTERN need one frame number such as %04d" << endl;
     return 1;
   }
+  const int newWidth = stoi(args[2]);
 
-  if (argc == 3) {
-    string file = argv[1];
-    string outfile = argv[2];
+  Sequence_Carver carver;
+  Sequence_Carver_init(&carver, sequenceOptions);
+  int number = ifstream(file) ? 0 : 1;
+  auto start = chrono::steady_clock::now();
 
-    ifstream fin(file);
-    if (!fin) {
-        cout << "Error opening file: " << file << endl;
-        return 2;
+  for (;; number++) {
+    frame_name(args[0], number, &file);
+    frame_name(args[1], number, &outfile);
+    if (!ifstream(file)) {
+      break;
     }
 
+    auto frameStart = chrono::steady_clock::now();
     Image img;
-    Image_init(&img, fin);
+    PPM_Format inFormat;
+    string error;
+    if (!Image_read_file(&img, file, &inFormat, &error)) {
+      cout << "Error reading file: " << file << ": " << error << endl;
+      return 2;
+    }
+    if (!(newWidth > 0) || !(newWidth <= Image_width(&img))) {
+      return 5;
+    }
 
-    Image dst;
-    crop_square_centered_at_max_energy(&img, &dst);
+    bool banded = Sequence_Carver_carve_width(&carver, &img, newWidth);
+    PPM_Format outFormat = options.formatGiven ? options.outFormat : inFormat;
+    if (!Image_write_file(&img, outfile, outFormat, &error)) {
+      cout << "Error writing file: " << error << endl;
+      return 6;
+    }
 
-    ofstream fout(outfile);
-    Image_print(&dst, fout);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count();
+    cout << number << '\t' << (banded ? "banded" : "full") << '\t' << file << '\t'
+         << outfile << '\t' << ms << endl;
   }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-  if (argc == 5) {
-    string file = argv[1];
-    string outfile = argv[2];
+  const int frames = carver.fullFrames + carver.bandedFrames;
+  if (frames == 0) {
+    cout << "Error reading file: " << file << ": no frames" << endl;
+    return 2;
+  }
+  cerr << frames << " frames, " << carver.bandedFrames << " banded, "
+       << carver.fullFrames << " full, " << seconds << " s" << endl;
+  return 0;
+}
+
+// One line of a batch manifest and how it went.
+struct Batch_Job {
+  int line;
+  vector<string> args;
+  int status;
+  string message;
+};
+
+// Runs every job in the manifest on a pool of the given number of
+// threads, each job on a single thread. Prints one tab-separated line per
+// job, in manifest order: line number, status (as for a single run, or 1
+// for a malformed line), input, output and any error message. Returns 0
+// if every job succeeded, 1 if the manifest can't be read and 7
+// otherwise.
+static int run_batch(const string &manifest, int threads,
+                     const Job_Options &options) {
+  ifstream in(manifest);
+  if (!in) {
+    cout << "Error reading manifest: " << manifest << endl;
+    return 1;
+  }
 
-    ifstream fin(file);
-    if (!fin) {
-        cout << "Error opening file: " << file << endl;
-        return 2;
+  // blank lines and lines starting with # are skipped
+  vector<Batch_Job> jobs;
+  string text;
+  for (int line = 1; getline(in, text); line++) {
+    istringstream fields(text);
+    Batch_Job job = { line, vector<string>(), 0, "" };
+    string field;
+    while (fields >> field) {
+      job.args.push_back(field);
+    }
+    if (job.args.empty() || job.args[0][0] == '#') {
+      continue;
+    }
+    jobs.push_back(job);
+  }
+
+  // the jobs themselves are spread over the threads, so each one runs
+  // its processing on a single thread, in its share of the memory
+  set_processing_threads(1);
+  Job_Options jobOptions = options;
+  if (options.maxMemory > 0) {
+    const long long running = max(1, min(threads, static_cast<int>(jobs.size())));
+    jobOptions.maxMemory = max(1LL, options.maxMemory / running);
+  }
+  ThreadPool pool;
+  ThreadPool_init(&pool, threads);
+
+  auto start = chrono::steady_clock::now();
+  ThreadPool_run_stealing(&pool, static_cast<int>(jobs.size()), [&](int i) {
+    Batch_Job &job = jobs[i];
+    if (job.args.size() < 2 || job.args.size() > 4) {
+      job.status = 1;
+      job.message = "expected IN_FILENAME OUT_FILENAME [WIDTH [HEIGHT]]";
+      return;
+    }
+    try {
+      job.status = run_job(job.args, jobOptions, &job.message);
+    } catch (const exception &e) {
+      job.status = 1;
+      job.message = string("bad job: ") + e.what();
+    }
+  });
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  ThreadPool_destroy(&pool);
+
+  int failed = 0;
+  for (const Batch_Job &job : jobs) {
+    cout << job.line << '\t' << job.status << '\t' << job.args[0] << '\t'
+         << (job.args.size() > 1 ? job.args[1] : "") << '\t' << job.message << '\n';
+    failed += job.status != 0;
+  }
+  cout.flush();
+  cerr << jobs.size() << " jobs, " << failed << " failed, " << seconds
+       << " s on " << threads << " threads" << endl;
+
+  return failed == 0 ? 0 : 7;
+}
+
+// Answers one file or data request (see server.hpp), setting *message
+// to any error and *payload to the resized image of a data request. The
+// request's payload is released once it is decoded. Returns the exit
+// status a single run would have, or 1 for a malformed request.
+static int serve_request(Server_Request* request, const Job_Options &options,
+                         string *message, string *payload) {
+  const vector<string> &fields = request->fields;
+  try {
+    if (fields[0] == "file" && fields.size() >= 3 && fields.size() <= 5) {
+      return run_job(vector<string>(fields.begin() + 1, fields.end()), options, message);
+    }
+    if (fields[0] != "data" || fields.size() > 4) {
+      *message = "expected file IN_FILENAME OUT_FILENAME [WIDTH [HEIGHT]], "
+                 "data LENGTH [WIDTH [HEIGHT]] or quit";
+      return 1;
+    }
+
+    Job_Options planned = options;
+    if (options.maxMemory > 0) {
+      PPM_Reader reader;
+      PPM_Reader_init(&reader, request->payload.data(), request->payload.size());
+      string note;
+      if (!plan_read(&reader, fields.size() - 2, false, &planned, &note, message)) {
+        return 8;
+      }
     }
 
     Image img;
-    Image_init(&img, fin);
+    PPM_Format inFormat;
+    string error;
+    if (!Image_read_memory(&img, request->payload.data(), request->payload.size(), &inFormat,
+                           &error)) {
+      *message = "Error reading data: " + error;
+      return fields.size() == 3 ? 4 : 2;
+    }
+    string().swap(request->payload);
+    int status = resize_image(&img, "", vector<string>(fields.begin() + 2, fields.end()), planned,
+                              message);
+    if (status != 0) {
+      return status;
+    }
 
-    int qWidth = stoi(argv[3]);
-    int qHeight = stoi(argv[4]);
+    // the output keeps the input's format unless --format picked one
+    ostringstream out;
+    Image_write(&img, out, options.formatGiven ? options.outFormat : inFormat);
+    *payload = out.str();
+    return 0;
+  } catch (const bad_alloc &) {
+    job_buffers = SeamCarver();
+    *message = "Out of memory resizing the request";
+    return 8;
+  } catch (const exception &e) {
+    *message = string("bad request: ") + e.what();
+    return 1;
+  }
+}
 
-    if (!(qWidth > 0) || !(qWidth <= Image_width(&img)) || !(qHeight > 0) || !(qHeight <= Image_height(&img))) {
-            cout << "Usage: resize.exe IN_FILENAME OUT_FILENAME WIDTH [HEIGHT]\n"
-            << "WIDTH and HEIGHT must be less than or equal to original" << endl;
-            return 3;
-        }
+// Answers requests on connection until its input ends, it is broken or a
+// quit request arrives, which sets *quit. The time each request took is
+// added to latencies.
+static void serve_connection(Server_Connection* connection, const Job_Options &options,
+                             vector<double>* latencies, bool* quit) {
+  Server_Request request;
+  string error;
+  while (Server_read_request(connection, &request, &error)) {
+    if (request.fields[0] == "quit") {
+      *quit = true;
+      return;
+    }
 
-    seam_carve(&img, qWidth, qHeight);
+    auto start = chrono::steady_clock::now();
+    string message;
+    string payload;
+    int status = serve_request(&request, options, &message, &payload);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    latencies->push_back(ms);
+    if (!Server_write_response(connection, status, ms, message, payload)) {
+      return;
+    }
+  }
+  if (!error.empty()) {
+    // the rest of the input can't be framed, so the connection ends here
+    Server_write_response(connection, 1, 0, "bad request: " + error, "");
+  }
+}
 
-    ofstream fout(outfile);
-    Image_print(&img, fout);
-    } else if (argc == 4) {
-        string file = argv[1];
-        string outfile = argv[2];
+// Runs the server on stdin and stdout, or on a Unix domain socket at
+// socketPath if it is not empty, taking one connection at a time. Every
+// request is carved with all of the processing threads, in buffers kept
+// from the requests before it. Stops after a quit request, or at the end
+// of stdin, and prints the number of requests and their median, 99th
+// percentile and slowest times to stderr. Returns 0, or 1 if the socket
+// can't be made or stops accepting connections.
+static int run_server(const string &socketPath, const Job_Options &options) {
+  // a client that goes away mid-response must not stop the server
+  signal(SIGPIPE, SIG_IGN);
 
-        ifstream fin(file);
-        if (!fin) {
-            cout << "Error opening file: " << file << endl;
-            return 4;
+  vector<double> latencies;
+  bool quit = false;
+  int status = 0;
+  Server_Connection connection;
+  if (socketPath.empty()) {
+    Server_Connection_init(&connection, STDIN_FILENO, STDOUT_FILENO);
+    serve_connection(&connection, options, &latencies, &quit);
+  } else {
+    string error;
+    int listener = Server_listen(socketPath, &error);
+    if (listener < 0) {
+      cout << "Error making socket: " << error << endl;
+      return 1;
+    }
+    while (!quit) {
+      int client = accept(listener, nullptr, nullptr);
+      if (client < 0) {
+        // anything but an interrupted call or a client that gave up would
+        // fail again on every try
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
         }
+        cout << "Error accepting a connection: " << strerror(errno) << endl;
+        status = 1;
+        break;
+      }
+      Server_Connection_init(&connection, client, client);
+      serve_connection(&connection, options, &latencies, &quit);
+      close(client);
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+  }
+
+  cerr << latencies.size() << " requests";
+  if (!latencies.empty()) {
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+      return latencies[min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    cerr << ", p50 " << percentile(0.5) << " ms, p99 " << percentile(0.99)
+         << " ms, max " << latencies.back() << " ms";
+  }
+  cerr << endl;
+  return status;
+}
+
+// Sets *bytes to text, a whole number of bytes with an optional K, M or
+// G suffix for 1024, 1024^2 or 1024^3 of them. Returns false if text is
+// not such a number, is 0 or is too large.
+static bool parse_bytes(const string &text, long long *bytes) {
+  size_t digits = text.find_first_not_of("0123456789");
+  if (text.empty() || digits == 0 || (digits != string::npos && digits + 1 < text.size()) ||
+      text.size() > 16) {
+    return false;
+  }
+  int shift = 0;
+  if (digits != string::npos) {
+    const char unit = static_cast<char>(toupper(static_cast<unsigned char>(text[digits])));
+    if (unit != 'K' && unit != 'M' && unit != 'G') {
+      return false;
+    }
+    shift = unit == 'K' ? 10 : unit == 'M' ? 20 : 30;
+  }
+  const long long count = stoll(text.substr(0, digits));
+  if (count == 0 || count > (LLONG_MAX >> shift)) {
+    return false;
+  }
+  *bytes = count << shift;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  // options may appear anywhere; everything else is positional
+  vector<string> args;
+  Job_Options options = { false, PPM_P3, { 0, 0 }, false, 0, 0, false, 0,
+                          CARVE_PRECISION_32, ENERGY_SOURCE_COLOR, 0 };
+  int threads = static_cast<int>(thread::hardware_concurrency());
+  string manifest;
+  bool sequence = false;
+  bool serve = false;
+  string socketPath;
+  Sequence_Options sequenceOptions = { 0, 0 };
+  bool profile = false;
+  string traceFile;
 
-        Image img;
-        Image_init(&img, fin);
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--format" && i + 1 < argc) {
+      if (!PPM_parse_format(argv[++i], &options.outFormat)) {
+        print_usage();
+        return 1;
+      }
+      options.formatGiven = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      string count = argv[++i];
+      if (count.empty() || count.find_first_not_of("0123456789") != string::npos ||
+          count.size() > 4 || stoi(count) == 0) {
+        print_usage();
+        return 1;
+      }
+      threads = stoi(count);
+    } else if (arg == "--batch" && i + 1 < argc) {
+      manifest = argv[++i];
+    } else if (arg == "--serve") {
+      serve = true;
+    } else if (arg == "--socket" && i + 1 < argc) {
+      serve = true;
+      socketPath = argv[++i];
+    } else if (arg == "--sequence") {
+      sequence = true;
+    } else if (arg == "--scene-change" && i + 1 < argc) {
+      string level = argv[++i];
+      if (level.empty() || level.find_first_not_of("0123456789") != string::npos ||
+          level.size() > 3 || stoi(level) > 255) {
+        print_usage();
+        return 1;
+      }
+      sequenceOptions.sceneChange = stoi(level);
+    } else if (arg == "--profile") {
+      profile = true;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      profile = true;
+      traceFile = argv[++i];
+    } else if ((arg == "--pyramid" || arg == "--band") && i + 1 < argc) {
+      string count = argv[++i];
+      if (count.empty() || count.find_first_not_of("0123456789") != string::npos ||
+          count.size() > 4) {
+        print_usage();
+        return 1;
+      }
+      (arg == "--pyramid" ? options.pyramid.levels : options.pyramid.band) = stoi(count);
+    } else if (arg == "--proxy" && i + 1 < argc) {
+      string factor = argv[++i];
+      if (factor.empty() || factor.find_first_not_of("0123456789") != string::npos ||
+          factor.size() > 4 || stoi(factor) == 0 || stoi(factor) > CROP_PROXY_MAX_FACTOR) {
+        print_usage();
+        return 1;
+      }
+      options.cropProxy = stoi(factor);
+    } else if (arg == "--crop" && i + 1 < argc) {
+      char rest;
+      if (sscanf(argv[++i], "%dx%d%c", &options.cropWidth, &options.cropHeight, &rest) != 2 ||
+          options.cropWidth <= 0 || options.cropHeight <= 0) {
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--precision" && i + 1 < argc) {
+      string bits = argv[++i];
+      if (bits != "16" && bits != "32" && bits != "steps") {
+        print_usage();
+        return 1;
+      }
+      options.precision = bits == "16" ? CARVE_PRECISION_16
+                        : bits == "32" ? CARVE_PRECISION_32 : CARVE_PRECISION_STEPS;
+    } else if (arg == "--max-memory" && i + 1 < argc) {
+      if (!parse_bytes(argv[++i], &options.maxMemory)) {
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--luma") {
+      options.source = ENERGY_SOURCE_LUMA;
+    } else if (arg == "--stream") {
+      options.stream = true;
+    } else if (arg == "--index") {
+      options.useIndex = true;
+    } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+      print_usage();
+      return 1;
+    } else {
+      args.push_back(arg);
+    }
+  }
 
-        int qWidth = stoi(argv[3]);
+  if (threads <= 0) {
+    threads = 1;
+  }
 
-        if (!(qWidth > 0) || !(qWidth <= Image_width(&img))) {
-            cout << "Usage: resize.exe IN_FILENAME OUT_FILENAME WIDTH [HEIGHT]\n"
-            << "WIDTH and HEIGHT must be less than or equal to original" << endl;
-            return 5;
-        }
+  if (!manifest.empty() && (!args.empty() || sequence)) {
+    print_usage();
+    return 1;
+  }
+  if (serve && (!args.empty() || sequence || !manifest.empty())) {
+    print_usage();
+    return 1;
+  }
+  if (sequence && args.size() != 3) {
+    print_usage();
+    return 1;
+  }
+  if (!serve && manifest.empty() && !(args.size() == 3 || args.size() == 4 || args.size() == 2)) {
+    print_usage();
+    return 1;
+  }
 
-        seam_carve_width(&img, qWidth);
+  if (profile) {
+    profile_start(!traceFile.empty());
+  }
+  // the plans keep each job within the budget; the limit stops whatever
+  // they miss at the allocation that would break it
+  memory_set_limit(options.maxMemory);
+
+  int status;
+  if (!manifest.empty()) {
+    status = run_batch(manifest, threads, options);
+  } else if (serve) {
+    set_processing_threads(threads);
+    status = run_server(socketPath, options);
+  } else if (sequence) {
+    set_processing_threads(threads);
+    sequenceOptions.band = options.pyramid.band;
+    try {
+      status = run_sequence(args, options, sequenceOptions);
+    } catch (const bad_alloc &) {
+      cout << "Out of memory carving the sequence" << endl;
+      status = 8;
+    }
+    if (status == 5) {
+      print_usage();
+    }
+  } else {
+    set_processing_threads(threads);
 
-        ofstream fout(outfile);
-        Image_print(&img, fout);
+    string message;
+    status = run_job(args, options, &message);
+    if (status == 3 || status == 5) {
+      // the usage explains the sizes
+      print_usage();
+    } else if (!message.empty()) {
+      cout << message << endl;
     }
-}
\ No newline at end of file
+  }
+
+  if (profile) {
+    profile_report(cerr);
+    string error;
+    if (!traceFile.empty() && !profile_write_trace(traceFile, &error)) {
+      cerr << "Error writing trace: " << error << endl;
+    }
+  }
+  return status;
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "seam_index.hpp"
+#include "processing.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+static const char SEAM_INDEX_MAGIC[] = "SEAMIDX1";
+static const int SEAM_INDEX_MAGIC_SIZE = 8;
+static const int SEAM_INDEX_HEADER_SIZE = SEAM_INDEX_MAGIC_SIZE + 4 + 4 + 8;
+
+// Widest image whose entries fit in 2 bytes.
+static const int SEAM_INDEX_SHORT_WIDTH = 65536;
+
+// Number of bytes per entry for an index of the given width.
+static int entry_size(int width) {
+  return width <= SEAM_INDEX_SHORT_WIDTH ? 2 : 4;
+}
+
+// Stores value in the size bytes at out, least significant byte first.
+static void put_le(unsigned char* out, unsigned long long value, int size) {
+  for (int k = 0; k < size; k++) {
+    out[k] = static_cast<unsigned char>(value >> (8 * k));
+  }
+}
+
+// Returns the size bytes at in as a little endian number.
+static unsigned long long get_le(const unsigned char* in, int size) {
+  unsigned long long value = 0;
+  for (int k = size - 1; k >= 0; k--) {
+    value = (value << 8) | in[k];
+  }
+  return value;
+}
+
+// REQUIRES: img points to a valid Image
+// EFFECTS:  Returns a 64-bit hash of the size and pixels of img, used to
+//           tell whether an index belongs to an image.
+unsigned long long Seam_Index_checksum(const Image* img) {
+  // FNV-1a over the size and then every row of every channel
+  unsigned long long hash = 14695981039346656037ULL;
+  auto add = [&hash](const unsigned char* bytes, int size) {
+    for (int k = 0; k < size; k++) {
+      hash = (hash ^ bytes[k]) * 1099511628211ULL;
+    }
+  };
+
+  unsigned char size[8];
+  put_le(size, static_cast<unsigned>(Image_width(img)), 4);
+  put_le(size + 4, static_cast<unsigned>(Image_height(img)), 4);
+  add(size, 8);
+  for (int ch = 0; ch < Image_channels(img); ch++) {
+    for (int r = 0; r < Image_height(img); r++) {
+      add(Image_row(img, ch, r), Image_width(img));
+    }
+  }
+  return hash;
+}
+
+// REQUIRES: index points to a Seam_Index, img points to a valid Image
+// MODIFIES: *index
+// EFFECTS:  Builds the index of img by carving a copy of it down to one
+//           column. This costs as much as seam_carve_width to a width of 1.
+void Seam_Index_init(Seam_Index* index, const Image* img) {
+  Image carved = *img;
+  seam_carve_width_order(&carved, 1, &index->order);
+  index->checksum = Seam_Index_checksum(img);
+}
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           needed to build the index of a width x height image with the
+//           given channels and apply it, not counting the image itself.
+//           Building needs more than reading an index from a file.
+long long Seam_Index_memory(int width, int height, int channels) {
+  // the carved copy, and the order, energy, cost and origin matrices of
+  // seam_carve_width_order; the output is smaller than the copy
+  const long long pixels = static_cast<long long>(width) * height;
+  return (channels + 4 * sizeof(int)) * pixels;
+}
+
+// REQUIRES: index points to a Seam_Index, img points to a valid Image
+// EFFECTS:  Returns true if index was built from an image with the same
+//           size and pixels as img.
+bool Seam_Index_matches(const Seam_Index* index, const Image* img) {
+  return Matrix_width(&index->order) == Image_width(img) &&
+         Matrix_height(&index->order) == Image_height(img) &&
+         index->checksum == Seam_Index_checksum(img);
+}
+
+// REQUIRES: index points to the Seam_Index of src (see Seam_Index_matches)
+//           0 < newWidth && newWidth <= Image_width(src)
+//           dst points to an Image
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to src reduced to newWidth columns. The result
+//           is the same as seam_carve_width(src, newWidth), found with one
+//           pass over the pixels.
+void Seam_Index_apply(const Seam_Index* index, const Image* src, Image* dst,
+                      int newWidth) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(src));
+  const int width = Image_width(src);
+  const int height = Image_height(src);
+  Image_init(dst, newWidth, height, Image_channels(src));
+
+  // carving to newWidth removes seams 0 .. width - newWidth - 1
+  const int firstKept = width - newWidth;
+  for (int r = 0; r < height; r++) {
+    const int* order = Matrix_at(&index->order, r, 0);
+    for (int ch = 0; ch < Image_channels(src); ch++) {
+      const unsigned char* in = Image_row(src, ch, r);
+      unsigned char* out = Image_row(dst, ch, r);
+      int c = 0;
+      for (int j = 0; j < width; j++) {
+        if (order[j] >= firstKept) {
+          out[c++] = in[j];
+        }
+      }
+    }
+  }
+}
+
+// REQUIRES: index points to a Seam_Index
+// MODIFIES: *index, *error
+// EFFECTS:  Reads an index written by Seam_Index_write_file. Returns false
+//           and sets *error if the file cannot be read or is malformed.
+bool Seam_Index_read_file(Seam_Index* index, const std::string& filename,
+                          std::string* error) {
+  PROFILE_SCOPE(PROFILE_READ, 0);
+  ifstream fin(filename, ios::binary);
+  if (!fin) {
+    *error = "cannot open " + filename;
+    return false;
+  }
+
+  unsigned char header[SEAM_INDEX_HEADER_SIZE];
+  if (!fin.read(reinterpret_cast<char*>(header), SEAM_INDEX_HEADER_SIZE) ||
+      memcmp(header, SEAM_INDEX_MAGIC, SEAM_INDEX_MAGIC_SIZE) != 0) {
+    *error = filename + " is not a seam index";
+    return false;
+  }
+  unsigned long long width = get_le(header + SEAM_INDEX_MAGIC_SIZE, 4);
+  unsigned long long height = get_le(header + SEAM_INDEX_MAGIC_SIZE + 4, 4);
+  if (width == 0 || height == 0 || width > 1000000 || height > 1000000 ||
+      width * height > 1000000000ULL) {
+    *error = filename + " has a bad size";
+    return false;
+  }
+
+  const int w = static_cast<int>(width);
+  const int h = static_cast<int>(height);
+  const int size = entry_size(w);
+  Matrix_init(&index->order, w, h);
+  index->checksum = get_le(header + SEAM_INDEX_MAGIC_SIZE + 8, 8);
+
+  vector<unsigned char> row(static_cast<size_t>(w) * size);
+  vector<int> seen(w);
+  for (int r = 0; r < h; r++) {
+    if (!fin.read(reinterpret_cast<char*>(row.data()), row.size())) {
+      *error = filename + " is truncated";
+      return false;
+    }
+    // every row must name each seam exactly once, or applying the index
+    // would not produce rows of the requested width
+    fill(seen.begin(), seen.end(), 0);
+    int* order = Matrix_at(&index->order, r, 0);
+    for (int j = 0; j < w; j++) {
+      unsigned long long value = get_le(&row[static_cast<size_t>(j) * size], size);
+      if (value >= width || seen[value]++) {
+        *error = filename + " is corrupt";
+        return false;
+      }
+      order[j] = static_cast<int>(value);
+    }
+  }
+
+  PROFILE_BYTES(SEAM_INDEX_HEADER_SIZE + static_cast<long long>(size) * w * h);
+  return true;
+}
+
+// REQUIRES: index points to an initialized Seam_Index
+// MODIFIES: *error
+// EFFECTS:  Writes the index to the named file: the magic "SEAMIDX1", the
+//           width and height as 32-bit and the checksum as 64-bit little
+//           endian integers, then order row by row, 2 bytes per entry
+//           (4 for images wider than 65536 pixels). Returns false and sets
+//           *error if the file cannot be written.
+bool Seam_Index_write_file(const Seam_Index* index, const std::string& filename,
+                           std::string* error) {
+  const int width = Matrix_width(&index->order);
+  const int height = Matrix_height(&index->order);
+  const int size = entry_size(width);
+  PROFILE_SCOPE(PROFILE_WRITE,
+                SEAM_INDEX_HEADER_SIZE + static_cast<long long>(size) * width * height);
+
+  ofstream fout(filename, ios::binary);
+  if (!fout) {
+    *error = "cannot open " + filename + " for writing";
+    return false;
+  }
+
+  unsigned char header[SEAM_INDEX_HEADER_SIZE];
+  memcpy(header, SEAM_INDEX_MAGIC, SEAM_INDEX_MAGIC_SIZE);
+  put_le(header + SEAM_INDEX_MAGIC_SIZE, static_cast<unsigned>(width), 4);
+  put_le(header + SEAM_INDEX_MAGIC_SIZE + 4, static_cast<unsigned>(height), 4);
+  put_le(header + SEAM_INDEX_MAGIC_SIZE + 8, index->checksum, 8);
+  fout.write(reinterpret_cast<const char*>(header), SEAM_INDEX_HEADER_SIZE);
+
+  vector<unsigned char> row(static_cast<size_t>(width) * size);
+  for (int r = 0; r < height; r++) {
+    const int* order = Matrix_at(&index->order, r, 0);
+    for (int j = 0; j < width; j++) {
+      put_le(&row[static_cast<size_t>(j) * size], static_cast<unsigned>(order[j]), size);
+    }
+    fout.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+
+  if (!fout) {
+    *error = "error while writing " + filename;
+    return false;
+  }
+  return true;
+}
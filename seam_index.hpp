@@ -0,0 +1,75 @@
+#ifndef SEAM_INDEX_HPP
+#define SEAM_INDEX_HPP
+
+/* seam_index.hpp
+ * A record of the order in which seam carving removes the pixels of an
+ * image. Once an image has been carved down to one column, it can be
+ * narrowed to any width by keeping the pixels that were removed last,
+ * without running the seam search again.
+ */
+
+#include <string>
+#include "Image.hpp"
+#include "Matrix.hpp"
+
+// The seam-removal order of one image.
+// order(i, j) is the number of the vertical seam that removes pixel
+// (i, j) when the image is carved down to a width of 1; the pixels that
+// are left over get width - 1. Every row holds each number exactly once.
+// checksum identifies the image the index was built from.
+struct Seam_Index {
+  Matrix order;
+  unsigned long long checksum;
+};
+
+// REQUIRES: img points to a valid Image
+// EFFECTS:  Returns a 64-bit hash of the size and pixels of img, used to
+//           tell whether an index belongs to an image.
+unsigned long long Seam_Index_checksum(const Image* img);
+
+// REQUIRES: 0 < width && 0 < height, channels is 1 or 3
+// EFFECTS:  Returns the most tracked memory (see memory.hpp), in bytes,
+//           needed to build the index of a width x height image with the
+//           given channels and apply it, not counting the image itself.
+//           Building needs more than reading an index from a file.
+long long Seam_Index_memory(int width, int height, int channels);
+
+// REQUIRES: index points to a Seam_Index, img points to a valid Image
+// MODIFIES: *index
+// EFFECTS:  Builds the index of img by carving a copy of it down to one
+//           column. This costs as much as seam_carve_width to a width of 1.
+void Seam_Index_init(Seam_Index* index, const Image* img);
+
+// REQUIRES: index points to a Seam_Index, img points to a valid Image
+// EFFECTS:  Returns true if index was built from an image with the same
+//           size and pixels as img.
+bool Seam_Index_matches(const Seam_Index* index, const Image* img);
+
+// REQUIRES: index points to the Seam_Index of src (see Seam_Index_matches)
+//           0 < newWidth && newWidth <= Image_width(src)
+//           dst points to an Image
+// MODIFIES: *dst
+// EFFECTS:  Initializes *dst to src reduced to newWidth columns. The result
+//           is the same as seam_carve_width(src, newWidth), found with one
+//           pass over the pixels.
+void Seam_Index_apply(const Seam_Index* index, const Image* src, Image* dst,
+                      int newWidth);
+
+// REQUIRES: index points to a Seam_Index
+// MODIFIES: *index, *error
+// EFFECTS:  Reads an index written by Seam_Index_write_file. Returns false
+//           and sets *error if the file cannot be read or is malformed.
+bool Seam_Index_read_file(Seam_Index* index, const std::string& filename,
+                          std::string* error);
+
+// REQUIRES: index points to an initialized Seam_Index
+// MODIFIES: *error
+// EFFECTS:  Writes the index to the named file: the magic "SEAMIDX1", the
+//           width and height as 32-bit and the checksum as 64-bit little
+//           endian integers, then order row by row, 2 bytes per entry
+//           (4 for images wider than 65536 pixels). Returns false and sets
+//           *error if the file cannot be written.
+bool Seam_Index_write_file(const Seam_Index* index, const std::string& filename,
+                           std::string* error);
+
+#endif // SEAM_INDEX_HPP
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "sequence.hpp"
+#include "image_view.hpp"
+#include "processing.hpp"
+#include "profile.hpp"
+
+using namespace std;
+
+// REQUIRES: carver points to a Sequence_Carver
+//           0 <= options.band && 0 <= options.sceneChange
+// MODIFIES: *carver
+// EFFECTS:  Starts a new sequence with the given options. The next frame
+//           is carved with a full search.
+void Sequence_Carver_init(Sequence_Carver* carver,
+                          const Sequence_Options &options) {
+  carver->options = options;
+  if (carver->options.band == 0) {
+    carver->options.band = SEQUENCE_DEFAULT_BAND;
+  }
+  if (carver->options.sceneChange == 0) {
+    carver->options.sceneChange = SEQUENCE_DEFAULT_SCENE_CHANGE;
+  }
+  carver->width = 0;
+  carver->height = 0;
+  carver->channels = 0;
+  carver->seams.clear();
+  carver->thumbnail.clear();
+  carver->fullFrames = 0;
+  carver->bandedFrames = 0;
+}
+
+// Replaces the carver's thumbnail with the block averages of img and
+// returns the mean absolute difference from the old one, or -1 if the
+// old thumbnail was of a different size. Averages change little when the
+// picture moves by a few pixels, unlike the pixels themselves.
+static int update_thumbnail(Sequence_Carver* carver, const Image* img) {
+  vector<unsigned char> &thumbnail = carver->thumbnail;
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  const int channels = Image_channels(img);
+  const int blocksWide = (width + SEQUENCE_BLOCK - 1) / SEQUENCE_BLOCK;
+  const int blocksHigh = (height + SEQUENCE_BLOCK - 1) / SEQUENCE_BLOCK;
+  const size_t blocks = static_cast<size_t>(channels) * blocksWide * blocksHigh;
+  const bool comparable = thumbnail.size() == blocks && carver->width == width &&
+                          carver->height == height && carver->channels == channels;
+  thumbnail.resize(blocks);
+
+  long long difference = 0;
+  vector<int> sums(blocksWide);
+  size_t i = 0;
+  for (int ch = 0; ch < channels; ch++) {
+    for (int top = 0; top < height; top += SEQUENCE_BLOCK) {
+      const int bottom = min(height, top + SEQUENCE_BLOCK);
+      fill(sums.begin(), sums.end(), 0);
+      for (int y = top; y < bottom; y++) {
+        const unsigned char* row = Image_row(img, ch, y);
+        for (int x = 0; x < width; x++) {
+          sums[x / SEQUENCE_BLOCK] += row[x];
+        }
+      }
+      for (int b = 0; b < blocksWide; b++, i++) {
+        const int count = (min(width, (b + 1) * SEQUENCE_BLOCK) - b * SEQUENCE_BLOCK) * (bottom - top);
+        const int average = (sums[b] + count / 2) / count;
+        difference += abs(average - thumbnail[i]);
+        thumbnail[i] = static_cast<unsigned char>(average);
+      }
+    }
+  }
+  return comparable ? static_cast<int>(difference / static_cast<long long>(blocks)) : -1;
+}
+
+// Sets *seams to the seams recorded in order, each in the columns of the
+// image it was removed from. A pixel removed by seam k was in column j of
+// the original image, left of which the seams before k had removed as
+// many pixels as there are numbers below k in its row so far; those are
+// counted with a Fenwick tree over the seam numbers.
+static void seams_from_order(const Matrix* order, int runs, vector<int>* seams) {
+  const int width = Matrix_width(order);
+  const int height = Matrix_height(order);
+  seams->resize(static_cast<size_t>(runs) * height);
+
+  vector<int> counts(runs + 1);
+  for (int r = 0; r < height; r++) {
+    fill(counts.begin(), counts.end(), 0);
+    const int* numbers = Matrix_at(order, r, 0);
+    for (int j = 0; j < width; j++) {
+      const int k = numbers[j];
+      if (k >= runs) {
+        continue;
+      }
+      int removedBefore = 0;
+      for (int n = k; n > 0; n -= n & -n) {
+        removedBefore += counts[n];
+      }
+      (*seams)[static_cast<size_t>(k) * height + r] = j - removedBefore;
+      for (int n = k + 1; n <= runs; n += n & -n) {
+        counts[n]++;
+      }
+    }
+  }
+}
+
+// Removes runs seams from img, searching seam k within the carver's band
+// around the previous frame's seam k, and records the new seams in its
+// place.
+static void carve_banded(Sequence_Carver* carver, Image* img, int runs) {
+  const int height = Image_height(img);
+  const int radius = carver->options.band;
+  Seam_Band &band = carver->band;
+  vector<int> &seam = carver->seam;
+
+  // the border value is the largest interior energy of the frame, as in
+  // the pyramid search
+  compute_energy_matrix(img, &carver->energy);
+  const int border = *Matrix_at(&carver->energy, 0, 0);
+
+  Seam_Band_init(&band, height, 2 * radius + 1);
+  Image_View view;
+  Image_View_init(&view, img);
+
+  int width = Image_width(img);
+  for (int k = 0; k < runs; k++) {
+    int* previous = &carver->seams[static_cast<size_t>(k) * height];
+    for (int r = 0; r < height; r++) {
+      band.lo[r] = max(0, previous[r] - radius);
+      band.hi[r] = min(width - 1, previous[r] + radius);
+    }
+
+    Seam_Band_energy(&view, &band, border);
+    if (Seam_Band_cost(&band, width, height)) {
+      Seam_Band_seam(&band, width, height, &seam);
+    } else {
+      compute_energy_matrix(img, &carver->energy);
+      compute_vertical_cost_matrix(&carver->energy, &carver->cost);
+      find_minimal_vertical_seam(&carver->cost, &seam);
+    }
+    copy(seam.begin(), seam.end(), previous);
+    remove_vertical_seam(img, seam);
+    width--;
+  }
+}
+
+// REQUIRES: carver was initialized with Sequence_Carver_init, img points
+//           to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Reduces the width of the frame img to newWidth. If the
+//           previous frame had the same size and channels, was carved to
+//           the same width and looks like this one, seam k is searched
+//           only within options.band columns of the previous frame's seam
+//           k, with energies and costs computed like seam_carve_width's
+//           except at the border: border pixels keep the frame's initial
+//           largest interior energy instead of following it as seams are
+//           removed, as in the pyramid search. Otherwise the frame is
+//           carved exactly like seam_carve_width. Returns true if the
+//           frame was carved in bands, false if it was carved with a full
+//           search.
+bool Sequence_Carver_carve_width(Sequence_Carver* carver, Image* img,
+                                 int newWidth) {
+  PROFILE_SCOPE(PROFILE_CARVE, Image_bytes(img));
+  const int width = Image_width(img);
+  const int height = Image_height(img);
+  const int runs = width - newWidth;
+
+  const int difference = update_thumbnail(carver, img);
+  const bool banded = difference >= 0 && difference <= carver->options.sceneChange &&
+                      carver->seams.size() == static_cast<size_t>(runs) * height &&
+                      runs > 0;
+  carver->width = width;
+  carver->height = height;
+  carver->channels = Image_channels(img);
+
+  if (banded) {
+    carve_banded(carver, img, runs);
+    carver->bandedFrames++;
+  } else {
+    seam_carve_width_order(img, newWidth, &carver->order);
+    seams_from_order(&carver->order, runs, &carver->seams);
+    carver->fullFrames++;
+  }
+  return banded;
+}
@@ -0,0 +1,85 @@
+#ifndef SEQUENCE_HPP
+#define SEQUENCE_HPP
+
+/* sequence.hpp
+ * Seam carving for the frames of a video. Neighbouring frames are nearly
+ * the same picture, so each frame's seams are searched only in a narrow
+ * band around the seams of the frame before it. That is much cheaper than
+ * a full search, and it keeps the seams from jumping around between
+ * frames, which shows as jitter. Frames that differ too much from the
+ * previous one are carved with a full search again.
+ */
+
+#include <vector>
+#include "Image.hpp"
+#include "Matrix.hpp"
+#include "band.hpp"
+
+// Settings for Sequence_Carver.
+struct Sequence_Options {
+  // Half-width, in pixels, of the band around each of the previous
+  // frame's seams; 0 picks SEQUENCE_DEFAULT_BAND. Wider bands follow
+  // motion better and are slower.
+  int band;
+  // Mean absolute difference between the block averages (0-255) of a
+  // frame and the one before it above which the frame counts as a new
+  // scene and is carved with a full search; 0 picks
+  // SEQUENCE_DEFAULT_SCENE_CHANGE.
+  int sceneChange;
+};
+
+const int SEQUENCE_DEFAULT_BAND = 8;
+const int SEQUENCE_DEFAULT_SCENE_CHANGE = 24;
+
+// Frames are compared by the averages of their SEQUENCE_BLOCK x
+// SEQUENCE_BLOCK blocks of pixels.
+const int SEQUENCE_BLOCK = 8;
+
+// The state carried from one frame to the next.
+// seams holds the seams removed from the previous frame in the order
+// they were removed, each in the columns of the image it was removed
+// from: row r of seam k is seams[k * height + r]. It is empty before the
+// first frame. thumbnail holds the block averages of the previous frame.
+struct Sequence_Carver {
+  Sequence_Options options;
+  int width;
+  int height;
+  int channels;
+  std::vector<int> seams;
+  std::vector<unsigned char> thumbnail;
+  Seam_Band band;
+  std::vector<int> seam;
+  Matrix energy;
+  Matrix cost;
+  Matrix order;
+  int fullFrames;
+  int bandedFrames;
+};
+
+// REQUIRES: carver points to a Sequence_Carver
+//           0 <= options.band && 0 <= options.sceneChange
+// MODIFIES: *carver
+// EFFECTS:  Starts a new sequence with the given options. The next frame
+//           is carved with a full search.
+void Sequence_Carver_init(Sequence_Carver* carver,
+                          const Sequence_Options &options);
+
+// REQUIRES: carver was initialized with Sequence_Carver_init, img points
+//           to a valid Image
+//           0 < newWidth && newWidth <= Image_width(img)
+// MODIFIES: *carver, *img
+// EFFECTS:  Reduces the width of the frame img to newWidth. If the
+//           previous frame had the same size and channels, was carved to
+//           the same width and looks like this one, seam k is searched
+//           only within options.band columns of the previous frame's seam
+//           k, with energies and costs computed like seam_carve_width's
+//           except at the border: border pixels keep the frame's initial
+//           largest interior energy instead of following it as seams are
+//           removed, as in the pyramid search. Otherwise the frame is
+//           carved exactly like seam_carve_width. Returns true if the
+//           frame was carved in bands, false if it was carved with a full
+//           search.
+bool Sequence_Carver_carve_width(Sequence_Carver* carver, Image* img,
+                                 int newWidth);
+
+#endif // SEQUENCE_HPP
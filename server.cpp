@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include "server.hpp"
+#include "memory.hpp"
+
+using namespace std;
+
+// How many bytes are read from a connection at a time.
+static const int READ_SIZE = 65536;
+
+// REQUIRES: connection points to a Server_Connection, in and out are open
+//           file descriptors
+// MODIFIES: *connection
+// EFFECTS:  Starts a conversation over the given file descriptors.
+void Server_Connection_init(Server_Connection* connection, int in, int out) {
+  connection->in = in;
+  connection->out = out;
+  connection->buffer.clear();
+}
+
+// Reads more of the input into the connection's buffer. Returns false at
+// the end of the input or on an error.
+static bool fill_buffer(Server_Connection* connection) {
+  char chunk[READ_SIZE];
+  ssize_t count;
+  do {
+    count = read(connection->in, chunk, sizeof chunk);
+  } while (count < 0 && errno == EINTR);
+  if (count <= 0) {
+    return false;
+  }
+  connection->buffer.append(chunk, static_cast<size_t>(count));
+  return true;
+}
+
+// REQUIRES: connection was initialized with Server_Connection_init,
+//           request points to a Server_Request
+// MODIFIES: *connection, *request, *error
+// EFFECTS:  Reads the next request. Blank lines are skipped. Returns false
+//           at the end of the input, with *error empty, or if the request
+//           line is too long or a data request's LENGTH is missing, too
+//           large or runs past the end of the input, with *error
+//           describing it. A LENGTH that is too large is refused before
+//           any of the payload is read.
+bool Server_read_request(Server_Connection* connection, Server_Request* request,
+                         string* error) {
+  string &buffer = connection->buffer;
+  error->clear();
+  request->fields.clear();
+  request->payload.clear();
+
+  while (request->fields.empty()) {
+    size_t end;
+    while ((end = buffer.find('\n')) == string::npos) {
+      if (buffer.size() > static_cast<size_t>(SERVER_MAX_LINE)) {
+        *error = "request line too long";
+        return false;
+      }
+      if (!fill_buffer(connection)) {
+        // a last line without a line break still counts
+        if (buffer.find_first_not_of(" \t\r") == string::npos) {
+          return false;
+        }
+        buffer += '\n';
+      }
+    }
+    if (end > static_cast<size_t>(SERVER_MAX_LINE)) {
+      *error = "request line too long";
+      return false;
+    }
+
+    istringstream line(buffer.substr(0, end));
+    buffer.erase(0, end + 1);
+    string field;
+    while (line >> field) {
+      request->fields.push_back(field);
+    }
+  }
+
+  if (request->fields[0] != "data") {
+    return true;
+  }
+  if (request->fields.size() < 2 ||
+      request->fields[1].find_first_not_of("0123456789") != string::npos ||
+      request->fields[1].size() > 10) {
+    *error = "data request without a LENGTH";
+    return false;
+  }
+  const long long length = stoll(request->fields[1]);
+  const long long limit = memory_limit() > 0 ? min(SERVER_MAX_DATA, memory_limit())
+                                             : SERVER_MAX_DATA;
+  if (length > limit) {
+    *error = "data LENGTH " + to_string(length) + " is over the limit of " +
+             to_string(limit) + " bytes";
+    return false;
+  }
+  // the payload is taken over whole, so room for it is made only once
+  buffer.reserve(static_cast<size_t>(length) + READ_SIZE);
+  while (buffer.size() < static_cast<size_t>(length)) {
+    if (!fill_buffer(connection)) {
+      *error = "data ended after " + to_string(buffer.size()) + " of " +
+               to_string(length) + " bytes";
+      return false;
+    }
+  }
+  // move the payload out rather than copy it, keeping only what follows
+  string rest = buffer.substr(length);
+  buffer.resize(length);
+  request->payload = move(buffer);
+  buffer = move(rest);
+  return true;
+}
+
+// Writes all of [data, data + size) to fd. Returns false on an error.
+static bool write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t count = write(fd, data, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    data += count;
+    size -= static_cast<size_t>(count);
+  }
+  return true;
+}
+
+// REQUIRES: connection was initialized with Server_Connection_init
+// MODIFIES: *connection
+// EFFECTS:  Writes a response with the given status, time and message,
+//           followed by payload. Line breaks in message are replaced by
+//           spaces. Returns false if the client has gone away.
+bool Server_write_response(Server_Connection* connection, int status,
+                           double milliseconds, const string &message,
+                           const string &payload) {
+  ostringstream line;
+  line << status << ' ' << milliseconds << ' ' << payload.size() << ' ';
+  for (char c : message) {
+    line << (c == '\n' || c == '\r' ? ' ' : c);
+  }
+  line << '\n';
+
+  // the line and a small payload go out in one write
+  string header = line.str();
+  if (payload.size() < static_cast<size_t>(READ_SIZE)) {
+    header += payload;
+    return write_all(connection->out, header.data(), header.size());
+  }
+  return write_all(connection->out, header.data(), header.size()) &&
+         write_all(connection->out, payload.data(), payload.size());
+}
+
+// REQUIRES: path names a place a Unix domain socket can be made
+// MODIFIES: *error
+// EFFECTS:  Listens on a Unix domain socket at path, replacing a socket
+//           already there, and returns its file descriptor, or -1 with
+//           *error describing why it could not. Anything else at path is
+//           left alone and is an error.
+int Server_listen(const string &path, string* error) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof address);
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof address.sun_path) {
+    *error = "socket path must be 1 to " + to_string(sizeof address.sun_path - 1) +
+             " bytes long";
+    return -1;
+  }
+  memcpy(address.sun_path, path.data(), path.size());
+
+  // a socket left by an earlier server is replaced; a mistyped path must
+  // not cost a file
+  struct stat existing;
+  if (lstat(path.c_str(), &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode)) {
+      *error = path + " exists and is not a socket";
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return -1;
+  }
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    *error = path + ": " + strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
@@ -0,0 +1,91 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+/* server.hpp
+ * The framed request protocol of the resize server, which keeps running
+ * between requests so that each one skips starting a process and
+ * allocating buffers.
+ *
+ * A request is one line of space-separated fields, in one of the forms
+ *
+ *   file IN_FILENAME OUT_FILENAME [WIDTH [HEIGHT]]
+ *   data LENGTH [WIDTH [HEIGHT]]
+ *   quit
+ *
+ * A data request is followed by LENGTH bytes holding a PPM file, at most
+ * SERVER_MAX_DATA or the memory limit (see memory.hpp), whichever is
+ * smaller. Without WIDTH the image is cropped, as on the command line.
+ * Every request but quit gets a response line
+ *
+ *   STATUS MILLISECONDS LENGTH MESSAGE
+ *
+ * followed by LENGTH bytes: the resized PPM file for a data request and
+ * nothing otherwise. STATUS is the exit status a single run would have
+ * returned, or 1 for a malformed request, and MILLISECONDS is the time
+ * taken from the end of the request to the response.
+ */
+
+#include <string>
+#include <vector>
+
+// Longest request line accepted, in bytes.
+const int SERVER_MAX_LINE = 4096;
+
+// Largest LENGTH a data request may have, in bytes. A payload is held
+// whole before it is decoded, so this bounds what one request can make
+// the server allocate; --max-memory lowers it further.
+const long long SERVER_MAX_DATA = 1LL << 30;
+
+// One end of a conversation with a client: requests are read from in and
+// responses written to out, which may be the same file descriptor.
+// buffer holds bytes read from in that have not been used yet.
+struct Server_Connection {
+  int in;
+  int out;
+  std::string buffer;
+};
+
+// A request as it was read.
+// fields are the words of the request line. payload holds the bytes
+// following a data request and is empty for other requests.
+struct Server_Request {
+  std::vector<std::string> fields;
+  std::string payload;
+};
+
+// REQUIRES: connection points to a Server_Connection, in and out are open
+//           file descriptors
+// MODIFIES: *connection
+// EFFECTS:  Starts a conversation over the given file descriptors.
+void Server_Connection_init(Server_Connection* connection, int in, int out);
+
+// REQUIRES: connection was initialized with Server_Connection_init,
+//           request points to a Server_Request
+// MODIFIES: *connection, *request, *error
+// EFFECTS:  Reads the next request. Blank lines are skipped. Returns false
+//           at the end of the input, with *error empty, or if the request
+//           line is too long or a data request's LENGTH is missing, too
+//           large or runs past the end of the input, with *error
+//           describing it. A LENGTH that is too large is refused before
+//           any of the payload is read.
+bool Server_read_request(Server_Connection* connection, Server_Request* request,
+                         std::string* error);
+
+// REQUIRES: connection was initialized with Server_Connection_init
+// MODIFIES: *connection
+// EFFECTS:  Writes a response with the given status, time and message,
+//           followed by payload. Line breaks in message are replaced by
+//           spaces. Returns false if the client has gone away.
+bool Server_write_response(Server_Connection* connection, int status,
+                           double milliseconds, const std::string &message,
+                           const std::string &payload);
+
+// REQUIRES: path names a place a Unix domain socket can be made
+// MODIFIES: *error
+// EFFECTS:  Listens on a Unix domain socket at path, replacing a socket
+//           already there, and returns its file descriptor, or -1 with
+//           *error describing why it could not. Anything else at path is
+//           left alone and is an error.
+int Server_listen(const std::string &path, std::string* error);
+
+#endif // SERVER_HPP
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstring>
+#include "step_kernels.hpp"
+#include "energy_kernels.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define STEP_HAVE_X86 1
+#endif
+
+using namespace std;
+
+// The vector kernels pick the step without branches: -1 where a <= b,
+// otherwise 0, and +1 where c is below both. The steps are narrowed from
+// 32-bit lanes to bytes with saturating packs, which keep -1, 0 and 1.
+
+typedef void (*Step_Kernel)(const int* prev, const int* e, int* out,
+                            signed char* steps, int lo, int hi);
+
+static void step_row_scalar(const int* prev, const int* e, int* out,
+                            signed char* steps, int lo, int hi) {
+  for (int j = lo; j <= hi; j++) {
+    int a = prev[j - 1];
+    int b = prev[j];
+    int c = prev[j + 1];
+    int ab = min(a, b);
+    out[j] = e[j] + min(ab, c);
+    int left = a <= b ? -1 : 0;
+    steps[j] = static_cast<signed char>(c < ab ? 1 : left);
+  }
+}
+
+#ifdef STEP_HAVE_X86
+
+__attribute__((target("sse4.1")))
+static void step_row_sse41(const int* prev, const int* e, int* out,
+                           signed char* steps, int lo, int hi) {
+  const __m128i ones = _mm_set1_epi32(-1);
+  const __m128i plus = _mm_set1_epi32(1);
+
+  int j = lo;
+  for (; j + 4 <= hi + 1; j += 4) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + j - 1));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + j));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + j + 1));
+    __m128i ab = _mm_min_epi32(a, b);
+    __m128i energy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(e + j));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j),
+                     _mm_add_epi32(energy, _mm_min_epi32(ab, c)));
+
+    __m128i left = _mm_xor_si128(_mm_cmpgt_epi32(a, b), ones);
+    __m128i step = _mm_blendv_epi8(left, plus, _mm_cmpgt_epi32(ab, c));
+    __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(step, step),
+                                    _mm_setzero_si128());
+    int packed = _mm_cvtsi128_si32(bytes);
+    memcpy(steps + j, &packed, 4);
+  }
+
+  step_row_scalar(prev, e, out, steps, j, hi);
+}
+
+__attribute__((target("avx2")))
+static void step_row_avx2(const int* prev, const int* e, int* out,
+                          signed char* steps, int lo, int hi) {
+  const __m256i ones = _mm256_set1_epi32(-1);
+  const __m256i plus = _mm256_set1_epi32(1);
+
+  int j = lo;
+  for (; j + 8 <= hi + 1; j += 8) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j - 1));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + j + 1));
+    __m256i ab = _mm256_min_epi32(a, b);
+    __m256i energy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(e + j));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j),
+                        _mm256_add_epi32(energy, _mm256_min_epi32(ab, c)));
+
+    __m256i left = _mm256_xor_si256(_mm256_cmpgt_epi32(a, b), ones);
+    __m256i step = _mm256_blendv_epi8(left, plus, _mm256_cmpgt_epi32(ab, c));
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(step),
+                                    _mm256_extracti128_si256(step, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(steps + j),
+                     _mm_packs_epi16(words, words));
+  }
+
+  step_row_scalar(prev, e, out, steps, j, hi);
+}
+
+#endif // STEP_HAVE_X86
+
+// The kernel matching the selected energy kernel. There is no 512-bit
+// version; the AVX-512 energy kernel pairs with the AVX2 one.
+static Step_Kernel selected_step_kernel() {
+  switch (energy_kernel_current()) {
+#ifdef STEP_HAVE_X86
+  case ENERGY_KERNEL_SSE41:
+    return step_row_sse41;
+  case ENERGY_KERNEL_AVX2:
+  case ENERGY_KERNEL_AVX512:
+    return step_row_avx2;
+#endif
+  default:
+    return step_row_scalar;
+  }
+}
+
+// REQUIRES: prev[lo - 1 .. hi + 1], e[lo..hi], out[lo..hi] and
+//           steps[lo..hi] are valid, and the four arrays do not overlap
+// MODIFIES: out[lo..hi], steps[lo..hi]
+// EFFECTS:  For each column j in [lo, hi], sets out[j] to
+//           e[j] + min(prev[j - 1], prev[j], prev[j + 1]) and steps[j] to
+//           -1, 0 or +1 for the first of those three that is the minimum.
+void step_compute_row(const int* prev, const int* e, int* out,
+                      signed char* steps, int lo, int hi) {
+  selected_step_kernel()(prev, e, out, steps, lo, hi);
+}
@@ -0,0 +1,20 @@
+#ifndef STEP_KERNELS_HPP
+#define STEP_KERNELS_HPP
+
+/* step_kernels.hpp
+ * Row kernel for find_minimal_vertical_seam_by_steps: one row of seam
+ * costs together with the step each pixel's seam takes to the row above.
+ * Vectorized versions follow the selected energy kernel and give exactly
+ * the same results as the scalar one.
+ */
+
+// REQUIRES: prev[lo - 1 .. hi + 1], e[lo..hi], out[lo..hi] and
+//           steps[lo..hi] are valid, and the four arrays do not overlap
+// MODIFIES: out[lo..hi], steps[lo..hi]
+// EFFECTS:  For each column j in [lo, hi], sets out[j] to
+//           e[j] + min(prev[j - 1], prev[j], prev[j + 1]) and steps[j] to
+//           -1, 0 or +1 for the first of those three that is the minimum.
+void step_compute_row(const int* prev, const int* e, int* out,
+                      signed char* steps, int lo, int hi);
+
+#endif // STEP_KERNELS_HPP
@@ -0,0 +1,52 @@
+#include "transpose_kernels.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// REQUIRES: src and dst each hold TRANSPOSE_TILE pointers; every src[k]
+//           points to TRANSPOSE_TILE readable bytes and every dst[k] to
+//           TRANSPOSE_TILE writable bytes
+// MODIFIES: dst[k][0..TRANSPOSE_TILE - 1] for each k
+// EFFECTS:  Sets dst[k][m] to src[m][k] for all k and m. The whole tile is
+//           read before anything is written, so dst may be the same tile
+//           as src.
+void transpose_tile(const unsigned char* const* src, unsigned char* const* dst) {
+#if defined(__SSE2__)
+  // Interleaving the bytes of rows k and k + 8 into rows 2k and 2k + 1
+  // rotates the 8-bit (row, column) index of every element left by one
+  // bit. Four rounds swap the row and column halves, which transposes
+  // the tile.
+  __m128i rows[TRANSPOSE_TILE];
+  for (int k = 0; k < TRANSPOSE_TILE; k++) {
+    rows[k] = _mm_loadu_si128((const __m128i*)src[k]);
+  }
+
+  for (int round = 0; round < 4; round++) {
+    __m128i next[TRANSPOSE_TILE];
+    for (int k = 0; k < TRANSPOSE_TILE / 2; k++) {
+      next[2 * k] = _mm_unpacklo_epi8(rows[k], rows[k + 8]);
+      next[2 * k + 1] = _mm_unpackhi_epi8(rows[k], rows[k + 8]);
+    }
+    for (int k = 0; k < TRANSPOSE_TILE; k++) {
+      rows[k] = next[k];
+    }
+  }
+
+  for (int k = 0; k < TRANSPOSE_TILE; k++) {
+    _mm_storeu_si128((__m128i*)dst[k], rows[k]);
+  }
+#else
+  unsigned char tile[TRANSPOSE_TILE][TRANSPOSE_TILE];
+  for (int m = 0; m < TRANSPOSE_TILE; m++) {
+    for (int k = 0; k < TRANSPOSE_TILE; k++) {
+      tile[k][m] = src[m][k];
+    }
+  }
+  for (int k = 0; k < TRANSPOSE_TILE; k++) {
+    for (int m = 0; m < TRANSPOSE_TILE; m++) {
+      dst[k][m] = tile[k][m];
+    }
+  }
+#endif
+}
@@ -0,0 +1,21 @@
+#ifndef TRANSPOSE_KERNELS_HPP
+#define TRANSPOSE_KERNELS_HPP
+
+/* transpose_kernels.hpp
+ * Square tile transpose for 8-bit planes, used by rotate_left and
+ * rotate_right. On x86 the tile is transposed in SSE2 registers.
+ */
+
+// Edge length, in pixels, of the tiles transposed by transpose_tile.
+const int TRANSPOSE_TILE = 16;
+
+// REQUIRES: src and dst each hold TRANSPOSE_TILE pointers; every src[k]
+//           points to TRANSPOSE_TILE readable bytes and every dst[k] to
+//           TRANSPOSE_TILE writable bytes
+// MODIFIES: dst[k][0..TRANSPOSE_TILE - 1] for each k
+// EFFECTS:  Sets dst[k][m] to src[m][k] for all k and m. The whole tile is
+//           read before anything is written, so dst may be the same tile
+//           as src.
+void transpose_tile(const unsigned char* const* src, unsigned char* const* dst);
+
+#endif // TRANSPOSE_KERNELS_HPP